@@ -1,13 +1,14 @@
 #define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/resource.h>
 #include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 #include <numa.h>
 
 #include "common.h"
@@ -19,7 +20,7 @@ void checkSyscall(const char *funcname, int result) {
   }
 }
 
-int create_udp_socket( const char *hostStr, unsigned short port, int receive ) {
+static struct addrinfo *resolve_udp( const char *hostStr, unsigned short port ) {
   struct addrinfo hints, *ai;
   int result;
 
@@ -36,6 +37,11 @@ int create_udp_socket( const char *hostStr, unsigned short port, int receive ) {
     exit(EXIT_FAILURE);
   }
 
+  return ai;
+}
+
+int create_udp_socket( const char *hostStr, unsigned short port, int receive ) {
+  struct addrinfo *ai = resolve_udp(hostStr, port);
   int fd;
 
   checkSyscall("socket()",
@@ -59,59 +65,423 @@ int create_udp_socket( const char *hostStr, unsigned short port, int receive ) {
   return fd;
 }
 
-void start(struct timer *t) { gettimeofday(&t->begin, 0); }
-void stop(struct timer *t)  { gettimeofday(&t->end, 0); }
+int create_unconnected_udp_socket( const char *hostStr, unsigned short port, struct sockaddr_in *addr ) {
+  struct addrinfo *ai = resolve_udp(hostStr, port);
+  int fd;
+
+  checkSyscall("socket()",
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+
+  memcpy(addr, ai->ai_addr, sizeof *addr);
+
+  freeaddrinfo(ai);
+
+  return fd;
+}
+
+int create_shared_udp_socket( const char *hostStr, unsigned short port, int cpu ) {
+  struct addrinfo *ai = resolve_udp(hostStr, port);
+  const int on = 1;
+  int fd;
+
+  checkSyscall("socket()",
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+
+  checkSyscall("setsockopt(SO_REUSEPORT)",
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on));
+
+  if (cpu >= 0) {
+    checkSyscall("setsockopt(SO_INCOMING_CPU)",
+      setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof cpu));
+  }
+
+  checkSyscall("bind()",
+    bind(fd, ai->ai_addr, ai->ai_addrlen));
+
+  freeaddrinfo(ai);
+
+  return fd;
+}
+
+void start(struct timer *t) { clock_gettime(CLOCK_MONOTONIC, &t->begin); }
+void stop(struct timer *t)  { clock_gettime(CLOCK_MONOTONIC, &t->end); }
 
 double duration(const struct timer t) {
-  return (double)(t.end.tv_sec - t.begin.tv_sec) + (double)(t.end.tv_usec - t.begin.tv_usec) / 1e6;
+  return (double)(t.end.tv_sec - t.begin.tv_sec) + (double)(t.end.tv_nsec - t.begin.tv_nsec) / 1e9;
+}
+
+double thread_cpu_seconds(void) {
+  struct rusage usage;
+
+  checkSyscall("getrusage()", getrusage(RUSAGE_THREAD, &usage));
+
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+       + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void hist_init(struct histogram *h) {
+  memset(h, 0, sizeof *h);
 }
 
-void timeval_add(struct timeval *t, size_t usec) {
-  t->tv_sec += usec / 1000000;
-  usec = usec % 1000000;
+static int hist_bucket(uint64_t value) {
+  if (value < HIST_SUB_BUCKETS)
+    return value;
+
+  const int msb = 63 - __builtin_clzll(value); /* >= 3 */
+  const int bucket = (msb - 2) * HIST_SUB_BUCKETS + ((value >> (msb - 3)) & (HIST_SUB_BUCKETS - 1));
+
+  return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+/* lowest value that falls into `bucket' */
+static uint64_t hist_bucket_floor(int bucket) {
+  if (bucket < HIST_SUB_BUCKETS)
+    return bucket;
+
+  const int msb = bucket / HIST_SUB_BUCKETS + 2;
+
+  return (uint64_t)(HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS) << (msb - 3);
+}
 
-  if ((t->tv_usec += usec) >= 1000000) {
-    t->tv_usec -= 1000000;
-    t->tv_sec++;
+void hist_add(struct histogram *h, int64_t value) {
+  if (value < 0) {
+    h->negative++;
+    value = 0;
   }
+
+  h->count[hist_bucket(value)]++;
+  h->total++;
+  h->sum += value;
+
+  if ((uint64_t)value > h->max)
+    h->max = value;
 }
 
-struct timeval timeval_diff(const struct timeval from, const struct timeval to) {
-  struct timeval diff;
+void hist_merge(struct histogram *total, const struct histogram *h) {
+  int i;
+
+  for (i = 0; i < HIST_BUCKETS; i++)
+    total->count[i] += h->count[i];
+
+  total->total    += h->total;
+  total->negative += h->negative;
+  total->sum      += h->sum;
+
+  if (h->max > total->max)
+    total->max = h->max;
+}
+
+uint64_t hist_percentile(const struct histogram *h, double perc) {
+  const double threshold = perc / 100.0 * h->total;
+  size_t seen = 0;
+  int i;
+
+  for (i = 0; i < HIST_BUCKETS - 1; i++) {
+    seen += h->count[i];
 
-  diff.tv_sec = to.tv_sec - from.tv_sec;
-  if (to.tv_usec >= from.tv_usec) {
-    diff.tv_usec = to.tv_usec - from.tv_usec;
+    if (seen >= threshold && seen > 0) {
+      const uint64_t upper = hist_bucket_floor(i + 1) - 1;
+      return upper < h->max ? upper : h->max;
+    }
+  }
+
+  return h->max;
+}
+
+double hist_mean(const struct histogram *h) {
+  return h->total ? h->sum / h->total : 0.0;
+}
+
+void hist_print(const char *prefix, const struct histogram *h, double scale, const char *unit) {
+  printf("%s mean %.1f%s, p50 %.1f%s, p99 %.1f%s, p99.9 %.1f%s, max %.1f%s\n",
+    prefix,
+    hist_mean(h) / scale, unit,
+    hist_percentile(h, 50.0) / scale, unit,
+    hist_percentile(h, 99.0) / scale, unit,
+    hist_percentile(h, 99.9) / scale, unit,
+    h->max / scale, unit);
+}
+
+void pacer_init(struct pacer *p, uint64_t spin_ns) {
+  memset(p, 0, sizeof *p);
+  p->spin_ns = spin_ns;
+}
+
+int pacer_wait(struct pacer *p, uint64_t deadline) {
+  uint64_t now = now_ns();
+  int late = 0;
+
+  p->nr_waits++;
+
+  if (now > deadline) {
+    /* return 1 if deadline already passed (too late) */
+    late = 1;
+    p->nr_late++;
   } else {
-    diff.tv_sec--;
-    diff.tv_usec = 1000000 + to.tv_usec - from.tv_usec;
+    /* sleep until shortly before the deadline */
+    if (deadline - now > p->spin_ns) {
+      const uint64_t wake_at = deadline - p->spin_ns;
+      const struct timespec ts = { wake_at / 1000000000ULL, wake_at % 1000000000ULL };
+
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+    }
+
+    /* spin for the rest */
+    while ((now = now_ns()) < deadline)
+      cpu_relax();
+  }
+
+  hist_add(&p->lateness, now - deadline);
+
+  return late;
+}
+
+void sampler_init(struct sampler *s, int nr_series, int interval_ms, const char *bad_name) {
+  int i;
+
+  memset(s, 0, sizeof *s);
+  s->interval_ms = interval_ms;
+  s->bad_name    = bad_name;
+  s->nr_series   = nr_series;
+
+  if (posix_memalign((void **)&s->series, 64, nr_series * sizeof *s->series) != 0) {
+    printf("ERROR: Could not allocate %d time series.\n", nr_series);
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < nr_series; i++) {
+    memset(&s->series[i], 0, sizeof s->series[i]);
+    snprintf(s->series[i].name, sizeof s->series[i].name, "%d", i);
+  }
+}
+
+void sampler_destroy(struct sampler *s) {
+  free(s->series);
+  free(s->time_ns);
+  free(s->bytes);
+  free(s->count);
+  free(s->bad);
+}
+
+/* Record the current totals of all series. */
+static void sampler_sample(struct sampler *s) {
+  const size_t n = s->nr_series;
+  size_t i;
+
+  if (s->nr_samples == s->capacity) {
+    s->capacity = s->capacity ? 2 * s->capacity : 1024;
+    s->time_ns  = realloc(s->time_ns, s->capacity * sizeof *s->time_ns);
+    s->bytes    = realloc(s->bytes, s->capacity * n * sizeof *s->bytes);
+    s->count    = realloc(s->count, s->capacity * n * sizeof *s->count);
+    s->bad      = realloc(s->bad, s->capacity * n * sizeof *s->bad);
+
+    if (!s->time_ns || !s->bytes || !s->count || !s->bad) {
+      printf("ERROR: Could not allocate %lu samples.\n", s->capacity);
+      exit(EXIT_FAILURE);
+    }
   }
 
-  return diff;
+  s->time_ns[s->nr_samples] = now_ns() - s->begin_ns;
+
+  for (i = 0; i < n; i++) {
+    s->bytes[s->nr_samples * n + i] = __atomic_load_n(&s->series[i].bytes, __ATOMIC_RELAXED);
+    s->count[s->nr_samples * n + i] = __atomic_load_n(&s->series[i].count, __ATOMIC_RELAXED);
+    s->bad[s->nr_samples * n + i]   = __atomic_load_n(&s->series[i].bad,   __ATOMIC_RELAXED);
+  }
+
+  s->nr_samples++;
 }
 
-int wait_until(const struct timeval t) {
-  struct timeval now;
-  gettimeofday(&now, 0);
+static void *sampler_thread(void *arg) {
+  struct sampler *s = arg;
+  uint64_t deadline = s->begin_ns;
 
-  /* return 1 if deadline already passed (too late) */
-  if( now.tv_sec > t.tv_sec ) return 1;
-  if( now.tv_sec == t.tv_sec && now.tv_usec > t.tv_usec ) return 1;
+  while (!s->stop) {
+    deadline += s->interval_ms * 1000000ULL;
 
-  /* sleep until the deadline */
-  struct timeval diff;
-  diff = timeval_diff(now, t);
-  select(0, NULL, NULL, NULL, &diff);
+    const struct timespec ts = { deadline / 1000000000ULL, deadline % 1000000000ULL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+
+    if (!s->stop)
+      sampler_sample(s);
+  }
+
+  return NULL;
+}
+
+void sampler_start(struct sampler *s) {
+  s->stop = 0;
+  s->begin_ns = now_ns();
+
+  if (pthread_create(&s->thread, NULL, sampler_thread, s) != 0) {
+    printf("ERROR: Could not start the sampler thread.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void sampler_stop(struct sampler *s) {
+  s->stop = 1;
+  pthread_join(s->thread, NULL);
+
+  sampler_sample(s);
+}
+
+int parse_output_format(const char *name, output_format_t *format) {
+  if (!strcmp(name, "json"))
+    *format = OUTPUT_JSON;
+  else if (!strcmp(name, "csv"))
+    *format = OUTPUT_CSV;
+  else
+    return -1;
 
-  /* success */
   return 0;
 }
 
+/* Write `str' as a quoted JSON or CSV string. */
+static void write_string(FILE *f, output_format_t format, const char *str) {
+  fputc('"', f);
+
+  for (; *str; str++) {
+    if (format == OUTPUT_CSV && *str == '"')
+      fputs("\"\"", f);
+    else if (format == OUTPUT_JSON && (*str == '"' || *str == '\\'))
+      fprintf(f, "\\%c", *str);
+    else if (format == OUTPUT_JSON && (unsigned char)*str < 0x20)
+      fprintf(f, "\\u%04x", *str);
+    else
+      fputc(*str, f);
+  }
+
+  fputc('"', f);
+}
+
+void sampler_write(const struct sampler *s, const char *filename, output_format_t format, const char *tool,
+                   const struct summary_value *summary, int nr_summary, int pass, const char *criterion) {
+  const int nr_series = s ? s->nr_series : 0;
+  const char *bad_name = s ? s->bad_name : "bad";
+  size_t i;
+  int j;
+
+  FILE *f = fopen(filename, "w");
+  if (!f) {
+    printf("ERROR: Could not open %s for writing: %s\n", filename, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  if (format == OUTPUT_JSON) {
+    fprintf(f, "{\n  \"tool\": ");
+    write_string(f, format, tool);
+    fprintf(f, ",\n  \"version\": \"%s\",\n  \"result\": \"%s\",\n  \"criterion\": ", VERSION, pass ? "pass" : "fail");
+    write_string(f, format, criterion);
+
+    fprintf(f, ",\n  \"summary\": {");
+    for (j = 0; j < nr_summary; j++) {
+      fprintf(f, "%s\n    ", j ? "," : "");
+      write_string(f, format, summary[j].name);
+      fprintf(f, ": %.6g", summary[j].value);
+    }
+    fprintf(f, "\n  },\n  \"interval_ms\": %d,\n  \"series\": [", s ? s->interval_ms : 0);
+  } else {
+    fprintf(f, "kind,name,time_s,gbit_per_s,%s_perc,value\n", bad_name);
+  }
+
+  /* time series, with the rate and percentage bad over each interval */
+  for (j = 0; j < nr_series; j++) {
+    uint64_t prev_time = 0, prev_bytes = 0, prev_count = 0, prev_bad = 0;
+
+    if (format == OUTPUT_JSON) {
+      fprintf(f, "%s\n    { \"name\": ", j ? "," : "");
+      write_string(f, format, s->series[j].name);
+      fprintf(f, ", \"samples\": [");
+    }
+
+    for (i = 0; i < s->nr_samples; i++) {
+      const uint64_t time  = s->time_ns[i];
+      const uint64_t bytes = s->bytes[i * nr_series + j];
+      const uint64_t count = s->count[i * nr_series + j];
+      const uint64_t bad   = s->bad[i * nr_series + j];
+
+      const double gbps = time > prev_time ? (bytes - prev_bytes) / GBPS / ((time - prev_time) / 1e9) : 0.0;
+      const double bad_perc = count > prev_count ? 100.0 * (bad - prev_bad) / (count - prev_count) : 0.0;
+
+      if (format == OUTPUT_JSON) {
+        fprintf(f, "%s\n      { \"time_s\": %.3f, \"gbit_per_s\": %.4f, \"%s_perc\": %.4f }", i ? "," : "", time / 1e9, gbps, bad_name, bad_perc);
+      } else {
+        fprintf(f, "sample,");
+        write_string(f, format, s->series[j].name);
+        fprintf(f, ",%.3f,%.4f,%.4f,\n", time / 1e9, gbps, bad_perc);
+      }
+
+      prev_time  = time;
+      prev_bytes = bytes;
+      prev_count = count;
+      prev_bad   = bad;
+    }
+
+    if (format == OUTPUT_JSON)
+      fprintf(f, "\n    ] }");
+  }
+
+  if (format == OUTPUT_JSON) {
+    fprintf(f, "\n  ]\n}\n");
+  } else {
+    for (j = 0; j < nr_summary; j++) {
+      fprintf(f, "summary,");
+      write_string(f, format, summary[j].name);
+      fprintf(f, ",,,,%.6g\n", summary[j].value);
+    }
+
+    fprintf(f, "result,%s,,,,\n", pass ? "pass" : "fail");
+  }
+
+  if (fclose(f) != 0) {
+    printf("ERROR: Could not write %s: %s\n", filename, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
 int nrNodes()
 {
   return numa_max_node() + 1;
 }
 
+int nodeCpus(int node, int *cpus, int maxCpus)
+{
+  struct bitmask *allowed = numa_allocate_cpumask();
+  struct bitmask *mask = numa_allocate_cpumask();
+  int cpu, n = 0;
+
+  /* the CPUs we may run on, f.e. restricted by taskset or a cgroup */
+  checkSyscall("numa_sched_getaffinity()", numa_sched_getaffinity(0, allowed));
+
+  if (node < 0) {
+    /* unknown node: use all CPUs we may run on */
+    copy_bitmask_to_bitmask(allowed, mask);
+  } else if (numa_node_to_cpus(node, mask) < 0) {
+    printf("ERROR: Could not determine the CPUs of NUMA node %d.\n", node);
+    exit(EXIT_FAILURE);
+  }
+
+  for (cpu = 0; cpu < numa_num_possible_cpus() && n < maxCpus; cpu++) {
+    if (numa_bitmask_isbitset(mask, cpu) && numa_bitmask_isbitset(allowed, cpu))
+      cpus[n++] = cpu;
+  }
+
+  numa_bitmask_free(mask);
+  numa_bitmask_free(allowed);
+
+  return n;
+}
+
 void setNodeAffinity(unsigned node)
 {
   if (numa_available() == -1) {
@@ -2,7 +2,11 @@
 #define __COMMON__
 
 #include <sys/time.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <time.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Version of this test suite */
 #define VERSION       "1.0"
@@ -19,9 +23,20 @@ void checkSyscall(const char *funcname, int result);
 /* Return a file descriptor connecting to or from hostStr:portStr. */
 int create_udp_socket( const char *hostStr, unsigned short port, int receive );
 
-/* Timer to record a time span. */
+/* Return an unconnected file descriptor for sending to hostStr:portStr and other
+ * ports, and fill `addr' with the address of hostStr:portStr.
+ */
+int create_unconnected_udp_socket( const char *hostStr, unsigned short port, struct sockaddr_in *addr );
+
+/* Return a file descriptor receiving on hostStr:portStr, that shares the port with
+ * other such sockets (SO_REUSEPORT). If cpu >= 0, the kernel prefers this socket
+ * for packets processed on that CPU (SO_INCOMING_CPU).
+ */
+int create_shared_udp_socket( const char *hostStr, unsigned short port, int cpu );
+
+/* Timer to record a time span, on CLOCK_MONOTONIC. */
 struct timer {
-  struct timeval begin, end;
+  struct timespec begin, end;
 };
 
 void start(struct timer *t);
@@ -30,23 +45,155 @@ void stop(struct timer *t);
 /* Return the duration between start(&t) and stop(&t), in seconds. */
 double duration(const struct timer t);
 
-/* Add `usec` microseconds to `t'. */
-void timeval_add(struct timeval *t, const size_t usec);
+/* Return the CPU time (user + system) consumed by the calling thread, in seconds. */
+double thread_cpu_seconds(void);
+
+/* Hint to the CPU that we are spinning. */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/* Return the time on CLOCK_MONOTONIC, in nanoseconds. */
+uint64_t now_ns(void);
+
+/* Histogram with logarithmic buckets, each power of two split into
+ * HIST_SUB_BUCKETS buckets, giving a resolution of 12.5%. Values are
+ * typically in nanoseconds.
+ */
+#define HIST_SUB_BUCKETS 8
+#define HIST_BUCKETS     (62 * HIST_SUB_BUCKETS)
+
+struct histogram {
+  size_t   count[HIST_BUCKETS];
+  size_t   total;
+  size_t   negative; /* values < 0, which are counted as 0 */
+  double   sum;
+  uint64_t max;
+};
+
+void hist_init(struct histogram *h);
+
+/* Add a value to the histogram. */
+void hist_add(struct histogram *h, int64_t value);
+
+/* Add all values of `h' to `total'. */
+void hist_merge(struct histogram *total, const struct histogram *h);
+
+/* Return the value below which `perc' percent of the values fall (upper bound of its bucket). */
+uint64_t hist_percentile(const struct histogram *h, double perc);
+
+/* Return the average value. */
+double hist_mean(const struct histogram *h);
+
+/* Print "<prefix>: mean p50 p99 p99.9 max" with values divided by `scale' and suffixed with `unit'. */
+void hist_print(const char *prefix, const struct histogram *h, double scale, const char *unit);
+
+/* Time before a deadline at which a pacer stops sleeping and starts spinning, in
+ * nanoseconds. This covers the typical wake-up latency of clock_nanosleep(). */
+#define PACER_SPIN_NS 50000
+
+/* Paces a loop to absolute deadlines on CLOCK_MONOTONIC.
+ *
+ * A pacer sleeps with clock_nanosleep(TIMER_ABSTIME) until `spin_ns' before a
+ * deadline, and spins for the rest, so it is neither affected by clock steps
+ * nor by the granularity of sleeps.
+ */
+struct pacer {
+  uint64_t spin_ns;
+  size_t nr_waits;
+  size_t nr_late;              /* deadlines that had already passed */
+  struct histogram lateness;   /* time from each deadline until the wait returned, in ns */
+};
 
-/* Return `to' - `from'. */
-struct timeval timeval_diff(const struct timeval from, const struct timeval to);
+void pacer_init(struct pacer *p, uint64_t spin_ns);
 
-/* Sleep until moment `t'.
+/* Wait until `deadline' (in ns on CLOCK_MONOTONIC, see now_ns()).
  *
- * Returns 1 if t already passed, 0 otherwise.
+ * Returns 1 if the deadline already passed, 0 otherwise.
  */
-int wait_until(const struct timeval t);
+int pacer_wait(struct pacer *p, uint64_t deadline);
+
+/* A time series of the progress of one station, stage or port. Its thread
+ * publishes running totals, which a sampler thread reads at fixed intervals.
+ * Each series is on its own cache lines, so publishing is cheap.
+ */
+struct series {
+  uint64_t bytes;  /* processed */
+  uint64_t count;  /* units (bytes, packets) accounted for */
+  uint64_t bad;    /* units that were late or lost */
+  char name[64];
+} __attribute__((aligned(64)));
+
+/* Publish the running totals of a series. Only one thread may update a series
+ * at a time. A NULL series is ignored. */
+static inline void series_update(struct series *s, uint64_t bytes, uint64_t count, uint64_t bad) {
+  if (!s)
+    return;
+
+  __atomic_store_n(&s->bytes, bytes, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->count, count, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->bad,   bad,   __ATOMIC_RELAXED);
+}
+
+/* Samples the series of a test every `interval_ms', from its own thread. */
+struct sampler {
+  int interval_ms;
+  const char *bad_name;   /* what `bad' means, f.e. "late" or "loss" */
+
+  int nr_series;
+  struct series *series;
+
+  /* sample i of series j is at [i * nr_series + j] */
+  size_t nr_samples, capacity;
+  uint64_t *time_ns;      /* since sampler_start() */
+  uint64_t *bytes, *count, *bad;
+
+  uint64_t begin_ns;
+  pthread_t thread;
+  volatile int stop;
+};
+
+void sampler_init(struct sampler *s, int nr_series, int interval_ms, const char *bad_name);
+
+void sampler_destroy(struct sampler *s);
+
+/* Start or stop sampling. sampler_stop() takes a final sample. */
+void sampler_start(struct sampler *s);
+void sampler_stop(struct sampler *s);
+
+/* Formats of the results written by sampler_write(). */
+typedef enum { OUTPUT_JSON, OUTPUT_CSV } output_format_t;
+
+/* Parse a name into an output format. Return 0 on success, -1 if the name is unknown. */
+int parse_output_format(const char *name, output_format_t *format);
+
+/* A figure of the summary of a test. */
+struct summary_value {
+  const char *name;
+  double value;
+};
+
+/* Write the results of `tool' to `filename': the time series of `s' (if not NULL),
+ * the summary, and whether the test passed `criterion'. Exits with an error if the
+ * file cannot be written.
+ */
+void sampler_write(const struct sampler *s, const char *filename, output_format_t format, const char *tool,
+                   const struct summary_value *summary, int nr_summary, int pass, const char *criterion);
 
 /*
  * Return the number of NUMA nodes available.
  */
 int nrNodes();
 
+/*
+ * Store the CPUs of NUMA node `node' (or of all nodes, if node < 0) that we may
+ * run on in cpus[], and return their number. This can be 0 for a node without
+ * CPUs, or whose CPUs are outside our affinity mask.
+ */
+int nodeCpus(int node, int *cpus, int maxCpus);
+
 /*
  * Bind this thread to run on a specific NUMA node.
  */
@@ -0,0 +1,136 @@
+#include <cuda.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "copy-engine.h"
+
+/* report and bail if the exit code from a CUDA function ("result") is not succesful */
+static void checkCuCall(const char *funcname, CUresult result) {
+  if (result != CUDA_SUCCESS) {
+    printf("Call %s failed with error code %d (see cuda.h)\n", funcname, result);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static int cuda_init(void) {
+  int nrDevices;
+
+  checkCuCall("cuInit",              cuInit(0));
+  checkCuCall("cuDeviceGetCount",    cuDeviceGetCount(&nrDevices));
+
+  return nrDevices;
+}
+
+static void *cuda_open(int device_nr, size_t *mem_size) {
+  CUdevice device;
+  CUcontext context;
+
+  checkCuCall("cuDeviceGet",         cuDeviceGet(&device, device_nr));
+  checkCuCall("cuDeviceTotalMem",    cuDeviceTotalMem(mem_size, device));
+  checkCuCall("cuCtxCreate",         cuCtxCreate(&context, 0, device));
+
+  return context;
+}
+
+static void cuda_close(void *dev) {
+  checkCuCall("cuCtxDestroy",        cuCtxDestroy(dev));
+}
+
+static void *cuda_host_alloc(void *dev, size_t size) {
+  void *ptr;
+
+  (void)dev;
+  checkCuCall("cuMemHostAlloc",      cuMemHostAlloc(&ptr, size, 0));
+  return ptr;
+}
+
+static void cuda_host_free(void *dev, void *ptr) {
+  (void)dev;
+  checkCuCall("cuMemFreeHost",       cuMemFreeHost(ptr));
+}
+
+static uint64_t cuda_dev_alloc(void *dev, size_t size) {
+  CUdeviceptr ptr;
+
+  (void)dev;
+  checkCuCall("cuMemAlloc",          cuMemAlloc(&ptr, size));
+  return ptr;
+}
+
+static void cuda_dev_free(void *dev, uint64_t ptr) {
+  (void)dev;
+  checkCuCall("cuMemFree",           cuMemFree(ptr));
+}
+
+static void *cuda_stream_create(void *dev) {
+  CUstream stream;
+
+  (void)dev;
+  checkCuCall("cuStreamCreate",      cuStreamCreate(&stream, CU_STREAM_NON_BLOCKING));
+  return stream;
+}
+
+static void cuda_stream_destroy(void *stream) {
+  checkCuCall("cuStreamDestroy",     cuStreamDestroy(stream));
+}
+
+static void cuda_stream_sync(void *stream) {
+  checkCuCall("cuStreamSynchronize", cuStreamSynchronize(stream));
+}
+
+static void cuda_htod(void *stream, uint64_t dst, const void *src, size_t size) {
+  checkCuCall("cuMemcpyHtoDAsync",   cuMemcpyHtoDAsync(dst, src, size, stream));
+}
+
+static void cuda_dtoh(void *stream, void *dst, uint64_t src, size_t size) {
+  checkCuCall("cuMemcpyDtoHAsync",   cuMemcpyDtoHAsync(dst, src, size, stream));
+}
+
+static void *cuda_event_create(void *dev) {
+  CUevent event;
+
+  (void)dev;
+  checkCuCall("cuEventCreate",       cuEventCreate(&event, CU_EVENT_DEFAULT));
+  return event;
+}
+
+static void cuda_event_destroy(void *event) {
+  checkCuCall("cuEventDestroy",      cuEventDestroy(event));
+}
+
+static void cuda_event_record(void *event, void *stream) {
+  checkCuCall("cuEventRecord",       cuEventRecord(event, stream));
+}
+
+static void cuda_stream_wait(void *stream, void *event) {
+  checkCuCall("cuStreamWaitEvent",   cuStreamWaitEvent(stream, event, 0));
+}
+
+static double cuda_elapsed(void *begin, void *end) {
+  float ms;
+
+  checkCuCall("cuEventSynchronize",  cuEventSynchronize(end));
+  checkCuCall("cuEventElapsedTime",  cuEventElapsedTime(&ms, begin, end));
+  return ms / 1e3;
+}
+
+const struct copy_backend cuda_backend = {
+  "cuda",
+  cuda_init,
+  cuda_open,
+  cuda_close,
+  cuda_host_alloc,
+  cuda_host_free,
+  cuda_dev_alloc,
+  cuda_dev_free,
+  cuda_stream_create,
+  cuda_stream_destroy,
+  cuda_stream_sync,
+  cuda_htod,
+  cuda_dtoh,
+  cuda_event_create,
+  cuda_event_destroy,
+  cuda_event_record,
+  cuda_stream_wait,
+  cuda_elapsed,
+};
@@ -0,0 +1,355 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "copy-engine.h"
+
+/* ----- Copy engine */
+
+void copy_engine_init(struct copy_engine *e, const struct copy_backend *backend, void *dev, int nr_streams) {
+  int d, s;
+
+  if (nr_streams < 1 || nr_streams > MAX_COPY_STREAMS) {
+    printf("ERROR: Number of streams must be between 1 and %d.\n", MAX_COPY_STREAMS);
+    exit(EXIT_FAILURE);
+  }
+
+  e->backend    = backend;
+  e->dev        = dev;
+  e->nr_streams = nr_streams;
+  e->begin      = backend->event_create(dev);
+
+  for (d = 0; d < 2; d++) {
+    for (s = 0; s < nr_streams; s++) {
+      e->streams[d][s] = backend->stream_create(dev);
+      e->end[d][s]     = backend->event_create(dev);
+    }
+  }
+}
+
+void copy_engine_destroy(struct copy_engine *e) {
+  const struct copy_backend *b = e->backend;
+  int d, s;
+
+  for (d = 0; d < 2; d++) {
+    for (s = 0; s < e->nr_streams; s++) {
+      b->event_destroy(e->end[d][s]);
+      b->stream_destroy(e->streams[d][s]);
+    }
+  }
+
+  b->event_destroy(e->begin);
+}
+
+struct copy_result copy_engine_run(struct copy_engine *e, int directions,
+                                   uint64_t dev_dst, const void *host_src,
+                                   void *host_dst, uint64_t dev_src,
+                                   size_t size, size_t chunk_size) {
+  const struct copy_backend *b = e->backend;
+  const int first = directions & COPY_HTOD ? 0 : 1;
+  struct copy_result result = { 0.0, 0.0, 0.0 };
+  double seconds[2] = { 0.0, 0.0 };
+  size_t offset;
+  int d, s, chunk;
+
+  /* let all streams start at the same time */
+  b->event_record(e->begin, e->streams[first][0]);
+
+  for (d = 0; d < 2; d++) {
+    if (!(directions & (1 << d)))
+      continue;
+
+    for (s = 0; s < e->nr_streams; s++) {
+      if (d != first || s != 0)
+        b->stream_wait(e->streams[d][s], e->begin);
+    }
+  }
+
+  /* queue the chunks round robin over the streams, alternating between the directions */
+  for (offset = 0, chunk = 0; offset < size; offset += chunk_size, chunk++) {
+    const size_t n = size - offset < chunk_size ? size - offset : chunk_size;
+    const int s = chunk % e->nr_streams;
+
+    if (directions & COPY_HTOD)
+      b->htod(e->streams[0][s], dev_dst + offset, (const char *)host_src + offset, n);
+
+    if (directions & COPY_DTOH)
+      b->dtoh(e->streams[1][s], (char *)host_dst + offset, dev_src + offset, n);
+  }
+
+  for (d = 0; d < 2; d++) {
+    if (!(directions & (1 << d)))
+      continue;
+
+    for (s = 0; s < e->nr_streams; s++)
+      b->event_record(e->end[d][s], e->streams[d][s]);
+  }
+
+  /* a direction is done when its last stream is */
+  for (d = 0; d < 2; d++) {
+    if (!(directions & (1 << d)))
+      continue;
+
+    for (s = 0; s < e->nr_streams; s++) {
+      b->stream_sync(e->streams[d][s]);
+
+      const double t = b->elapsed(e->begin, e->end[d][s]);
+      if (t > seconds[d])
+        seconds[d] = t;
+    }
+  }
+
+  if (directions & COPY_HTOD)
+    result.htod_gbps = size / GBPS / seconds[0];
+
+  if (directions & COPY_DTOH)
+    result.dtoh_gbps = size / GBPS / seconds[1];
+
+  result.total_gbps = size * ((directions & COPY_HTOD ? 1 : 0) + (directions & COPY_DTOH ? 1 : 0))
+                    / GBPS / (seconds[0] > seconds[1] ? seconds[0] : seconds[1]);
+
+  return result;
+}
+
+/* ----- Host backend: a "device" per NUMA node, in host memory */
+
+/* Amount of memory of a host device. */
+#define HOST_DEVICE_MEM  (1024UL * 1024 * 1024)
+
+/* Maximum number of operations queued on a host stream. */
+#define HOST_STREAM_OPS  1024
+
+/* Time a host stream sleeps while waiting for an event, in ns. */
+#define HOST_WAIT_NS     10000
+
+struct host_device {
+  int node;
+};
+
+struct host_event {
+  uint64_t time_ns;  /* when it happened */
+  int done;
+};
+
+struct host_op {
+  enum { OP_COPY, OP_RECORD, OP_WAIT, OP_STOP } type;
+  void *dst;
+  const void *src;
+  size_t size;
+  struct host_event *event;
+};
+
+/* A thread executing operations in order. */
+struct host_stream {
+  struct host_device *dev;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  struct host_op ops[HOST_STREAM_OPS];
+  size_t head;   /* next op to execute; only advanced once it is done */
+  size_t tail;   /* next free slot */
+};
+
+static void *host_stream_thread(void *arg) {
+  struct host_stream *s = arg;
+  int stop = 0;
+
+  /* copy on the node of the device */
+  setNodeAffinity(s->dev->node);
+
+  while (!stop) {
+    pthread_mutex_lock(&s->lock);
+    while (s->head == s->tail)
+      pthread_cond_wait(&s->cond, &s->lock);
+    const struct host_op op = s->ops[s->head % HOST_STREAM_OPS];
+    pthread_mutex_unlock(&s->lock);
+
+    switch (op.type) {
+      case OP_COPY:
+        memcpy(op.dst, op.src, op.size);
+        break;
+
+      case OP_RECORD:
+        op.event->time_ns = now_ns();
+        __atomic_store_n(&op.event->done, 1, __ATOMIC_RELEASE);
+        break;
+
+      case OP_WAIT:
+        while (!__atomic_load_n(&op.event->done, __ATOMIC_ACQUIRE)) {
+          const struct timespec ts = { 0, HOST_WAIT_NS };
+          nanosleep(&ts, NULL);
+        }
+        break;
+
+      case OP_STOP:
+        stop = 1;
+        break;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->head++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  return NULL;
+}
+
+static void host_stream_push(struct host_stream *s, struct host_op op) {
+  pthread_mutex_lock(&s->lock);
+  while (s->tail - s->head == HOST_STREAM_OPS)
+    pthread_cond_wait(&s->cond, &s->lock);
+
+  s->ops[s->tail % HOST_STREAM_OPS] = op;
+  s->tail++;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+}
+
+static int host_init(void) {
+  return nrNodes();
+}
+
+static void *host_open(int device_nr, size_t *mem_size) {
+  struct host_device *dev = malloc(sizeof *dev);
+
+  dev->node = device_nr;
+  setNodeAffinity(device_nr);
+
+  *mem_size = HOST_DEVICE_MEM;
+  return dev;
+}
+
+static void host_close(void *dev) {
+  free(dev);
+}
+
+static void *host_host_alloc(void *dev, size_t size) {
+  void *ptr;
+
+  (void)dev;
+
+  if (posix_memalign(&ptr, 4096, size) != 0) {
+    printf("ERROR: Could not allocate %lu bytes.\n", size);
+    exit(EXIT_FAILURE);
+  }
+
+  /* place it now, on the node of the calling thread */
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+static void host_host_free(void *dev, void *ptr) {
+  (void)dev;
+  free(ptr);
+}
+
+static uint64_t host_dev_alloc(void *dev, size_t size) {
+  return (uintptr_t)host_host_alloc(dev, size);
+}
+
+static void host_dev_free(void *dev, uint64_t ptr) {
+  host_host_free(dev, (void *)(uintptr_t)ptr);
+}
+
+static void *host_stream_create(void *dev) {
+  struct host_stream *s = calloc(1, sizeof *s);
+
+  s->dev = dev;
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+
+  if (pthread_create(&s->thread, NULL, host_stream_thread, s) != 0) {
+    printf("ERROR: Could not start a stream thread.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return s;
+}
+
+static void host_stream_destroy(void *stream) {
+  struct host_stream *s = stream;
+  const struct host_op op = { OP_STOP, NULL, NULL, 0, NULL };
+
+  host_stream_push(s, op);
+  pthread_join(s->thread, NULL);
+
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+}
+
+static void host_stream_sync(void *stream) {
+  struct host_stream *s = stream;
+
+  pthread_mutex_lock(&s->lock);
+  while (s->head != s->tail)
+    pthread_cond_wait(&s->cond, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+}
+
+static void host_htod(void *stream, uint64_t dst, const void *src, size_t size) {
+  const struct host_op op = { OP_COPY, (void *)(uintptr_t)dst, src, size, NULL };
+
+  host_stream_push(stream, op);
+}
+
+static void host_dtoh(void *stream, void *dst, uint64_t src, size_t size) {
+  const struct host_op op = { OP_COPY, dst, (const void *)(uintptr_t)src, size, NULL };
+
+  host_stream_push(stream, op);
+}
+
+static void *host_event_create(void *dev) {
+  (void)dev;
+  return calloc(1, sizeof(struct host_event));
+}
+
+static void host_event_destroy(void *event) {
+  free(event);
+}
+
+static void host_event_record(void *event, void *stream) {
+  struct host_event *e = event;
+  const struct host_op op = { OP_RECORD, NULL, NULL, 0, e };
+
+  __atomic_store_n(&e->done, 0, __ATOMIC_RELEASE);
+  host_stream_push(stream, op);
+}
+
+static void host_stream_wait(void *stream, void *event) {
+  const struct host_op op = { OP_WAIT, NULL, NULL, 0, event };
+
+  host_stream_push(stream, op);
+}
+
+static double host_elapsed(void *begin, void *end) {
+  const struct host_event *b = begin, *e = end;
+
+  return ((int64_t)e->time_ns - (int64_t)b->time_ns) / 1e9;
+}
+
+const struct copy_backend host_backend = {
+  "host",
+  host_init,
+  host_open,
+  host_close,
+  host_host_alloc,
+  host_host_free,
+  host_dev_alloc,
+  host_dev_free,
+  host_stream_create,
+  host_stream_destroy,
+  host_stream_sync,
+  host_htod,
+  host_dtoh,
+  host_event_create,
+  host_event_destroy,
+  host_event_record,
+  host_stream_wait,
+  host_elapsed,
+};
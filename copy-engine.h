@@ -0,0 +1,93 @@
+#ifndef __COPY_ENGINE__
+#define __COPY_ENGINE__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Operations on a device to copy to and from, with asynchronous streams and
+ * events, modelled after the CUDA driver API. All functions bail on errors.
+ *
+ * Devices, streams and events are opaque handles. Device memory is addressed
+ * by an integer, like a CUdeviceptr.
+ */
+struct copy_backend {
+  const char *name;
+
+  /* Initialise, and return the number of devices. */
+  int      (*init)(void);
+
+  /* Open device `device_nr' for the calling thread, and return its memory size in `mem_size'. */
+  void    *(*open)(int device_nr, size_t *mem_size);
+  void     (*close)(void *dev);
+
+  /* Memory on the host (pinned), and on the device. */
+  void    *(*host_alloc)(void *dev, size_t size);
+  void     (*host_free)(void *dev, void *ptr);
+  uint64_t (*dev_alloc)(void *dev, size_t size);
+  void     (*dev_free)(void *dev, uint64_t ptr);
+
+  /* Streams execute their operations in order, and concurrently with other streams. */
+  void    *(*stream_create)(void *dev);
+  void     (*stream_destroy)(void *stream);
+  void     (*stream_sync)(void *stream);
+
+  /* Queue a copy on a stream. */
+  void     (*htod)(void *stream, uint64_t dst, const void *src, size_t size);
+  void     (*dtoh)(void *stream, void *dst, uint64_t src, size_t size);
+
+  /* Events mark a point in a stream. */
+  void    *(*event_create)(void *dev);
+  void     (*event_destroy)(void *event);
+  void     (*event_record)(void *event, void *stream);
+  void     (*stream_wait)(void *stream, void *event);  /* hold the stream until the event happened */
+  double   (*elapsed)(void *begin, void *end);       /* in seconds, once both happened */
+};
+
+/* Backend that emulates a device per NUMA node in host memory, with a thread per stream. */
+extern const struct copy_backend host_backend;
+
+#ifndef NO_CUDA
+extern const struct copy_backend cuda_backend;
+#endif
+
+/* Directions to copy in. */
+#define COPY_HTOD 1
+#define COPY_DTOH 2
+
+/* Maximum number of streams per direction. */
+#define MAX_COPY_STREAMS 16
+
+/* Splits transfers into chunks, which are spread over several streams per
+ * direction, so uploads and downloads overlap each other.
+ */
+struct copy_engine {
+  const struct copy_backend *backend;
+  void *dev;
+  int nr_streams;                                  /* per direction */
+
+  void *streams[2][MAX_COPY_STREAMS];              /* [0] = htod, [1] = dtoh */
+  void *begin;                                     /* all streams start after this event */
+  void *end[2][MAX_COPY_STREAMS];                  /* end of the work of each stream */
+};
+
+/* Speeds of a run, in Gbit/s. */
+struct copy_result {
+  double htod_gbps;
+  double dtoh_gbps;
+  double total_gbps;   /* both directions together */
+};
+
+void copy_engine_init(struct copy_engine *e, const struct copy_backend *backend, void *dev, int nr_streams);
+
+void copy_engine_destroy(struct copy_engine *e);
+
+/* Copy `size' bytes from host_src to dev_dst (COPY_HTOD) and/or from dev_src to
+ * host_dst (COPY_DTOH) at the same time, in chunks of `chunk_size' bytes, and
+ * return the speeds as measured with events.
+ */
+struct copy_result copy_engine_run(struct copy_engine *e, int directions,
+                                   uint64_t dev_dst, const void *host_src,
+                                   void *host_dst, uint64_t dev_src,
+                                   size_t size, size_t chunk_size);
+
+#endif
@@ -0,0 +1,416 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "common.h"
+#include "disk-io.h"
+
+/* Number of bytes in a megabyte, as used by dd and in the compliance criteria. */
+#define MBYTE         (1000.0*1000.0)
+
+/* Maximum number of disks to test. */
+#define MAX_DISKS     64
+
+/* Result of one phase (write or read) on one disk. */
+struct phase {
+  size_t nr_bytes;
+  double seconds;
+  struct histogram latency;  /* of each request, in ns */
+};
+
+/* Result of one disk. */
+struct report {
+  const char *path;
+  int node;                  /* NUMA node of the disk, or -1 if unknown */
+  int direct;                /* whether O_DIRECT was used */
+  engine_t engine;           /* engine used, which can differ from the one requested */
+  struct phase write, read;
+};
+
+/* Parameters of a run. */
+struct bench {
+  size_t file_size;          /* per disk */
+  size_t block_size;
+  unsigned queue_depth;
+  engine_t engine;
+};
+
+/* Write or read (opcode IORING_OP_WRITE or IORING_OP_READ) the whole file through
+ * an io_uring, keeping `queue_depth' requests in flight. Publishes the progress in
+ * `series', if not NULL. */
+static void run_uring(struct uring *u, int opcode, int fd, const struct bench *b, char **buffers, struct phase *result, struct series *series) {
+  uint64_t submit_ns[b->queue_depth];
+  unsigned free_slots[b->queue_depth];
+  unsigned nr_free = b->queue_depth, nr_queued = 0, i;
+  size_t next_offset = 0;
+
+  for (i = 0; i < b->queue_depth; i++)
+    free_slots[i] = i;
+
+  while (result->nr_bytes < b->file_size) {
+    /* fill the queue */
+    while (nr_free > 0 && next_offset < b->file_size) {
+      const unsigned slot = free_slots[--nr_free];
+
+      submit_ns[slot] = now_ns();
+      uring_prep(u, opcode, fd, buffers[slot], b->block_size, next_offset, slot);
+
+      next_offset += b->block_size;
+      nr_queued++;
+    }
+
+    uring_submit(u, nr_queued, 1);
+    nr_queued = 0;
+
+    /* process the completions */
+    uint64_t slot;
+    int res;
+
+    while (uring_reap(u, &slot, &res)) {
+      if (res < 0) {
+        printf("ERROR: %s failed: %s\n", opcode == IORING_OP_WRITE ? "Write" : "Read", strerror(-res));
+        exit(EXIT_FAILURE);
+      }
+
+      if ((size_t)res != b->block_size) {
+        printf("ERROR: Short %s of %d of %lu bytes.\n", opcode == IORING_OP_WRITE ? "write" : "read", res, b->block_size);
+        exit(EXIT_FAILURE);
+      }
+
+      hist_add(&result->latency, now_ns() - submit_ns[slot]);
+      result->nr_bytes += res;
+      free_slots[nr_free++] = slot;
+    }
+
+    series_update(series, result->nr_bytes, result->nr_bytes, 0);
+  }
+}
+
+/* Write or read the whole file with pwrite()/pread(), one block at a time. */
+static void run_sync(int write, int fd, const struct bench *b, char *buffer, struct phase *result, struct series *series) {
+  while (result->nr_bytes < b->file_size) {
+    const uint64_t begin = now_ns();
+    ssize_t res;
+
+    do {
+      res = write ? pwrite(fd, buffer, b->block_size, result->nr_bytes)
+                  : pread(fd, buffer, b->block_size, result->nr_bytes);
+    } while (res < 0 && errno == EINTR);
+
+    checkSyscall(write ? "pwrite()" : "pread()", res);
+
+    if ((size_t)res != b->block_size) {
+      printf("ERROR: Short %s of %ld of %lu bytes.\n", write ? "write" : "read", res, b->block_size);
+      exit(EXIT_FAILURE);
+    }
+
+    hist_add(&result->latency, now_ns() - begin);
+    result->nr_bytes += res;
+
+    series_update(series, result->nr_bytes, result->nr_bytes, 0);
+  }
+}
+
+/* Run one phase on an open file. */
+static void run_phase(struct report *r, struct uring *u, int write, int fd, const struct bench *b, char **buffers, struct series *series) {
+  struct timer t;
+
+  hist_init(&(write ? &r->write : &r->read)->latency);
+
+  start(&t);
+  if (r->engine == ENGINE_URING)
+    run_uring(u, write ? IORING_OP_WRITE : IORING_OP_READ, fd, b, buffers, write ? &r->write : &r->read, series);
+  else
+    run_sync(write, fd, b, buffers[0], write ? &r->write : &r->read, series);
+
+  /* make sure the data reached the disk */
+  if (write)
+    checkSyscall("fdatasync()", fdatasync(fd));
+  stop(&t);
+
+  (write ? &r->write : &r->read)->seconds = duration(t);
+}
+
+static void print_phase(int disk, const char *what, const struct phase *p) {
+  char prefix[64];
+
+  printf("Disk %d: %s %.2f GByte in %.2f seconds: %.1f MB/s\n", disk, what, p->nr_bytes / GBYTE, p->seconds, p->nr_bytes / MBYTE / p->seconds);
+
+  snprintf(prefix, sizeof prefix, "Disk %d: Latency:", disk);
+  hist_print(prefix, &p->latency, 1e6, "ms");
+}
+
+/* Test one disk through r->path, synchronised with the other disks. Must be
+ * called by every thread of an omp parallel region. */
+static void test_disk(struct report *r, int disk, const struct bench *b, int keep, struct series *write_series, struct series *read_series) {
+  char *buffers[b->queue_depth];
+  struct uring u;
+  unsigned i;
+  int fd;
+
+  /* run close to the disk */
+  if (r->node >= 0)
+    setNodeAffinity(r->node);
+
+  r->engine = b->engine;
+  if (r->engine == ENGINE_URING && uring_init(&u, b->queue_depth) < 0) {
+    printf("Disk %d: io_uring not available (%s), falling back to pwrite()/pread().\n", disk, strerror(errno));
+    r->engine = ENGINE_SYNC;
+  }
+
+  /* every request in flight needs its own buffer for reads */
+  for (i = 0; i < b->queue_depth; i++) {
+    buffers[i] = alloc_direct(b->block_size);
+    memset(buffers[i], 0x5a + i, b->block_size);
+  }
+
+  fd = open_direct(r->path, O_CREAT | O_TRUNC | O_WRONLY, &r->direct);
+  if (!r->direct)
+    printf("Disk %d: %s does not support O_DIRECT, using the page cache.\n", disk, r->path);
+
+#pragma omp barrier
+#pragma omp single
+  printf("Writing...\n");
+
+  run_phase(r, &u, 1, fd, b, buffers, write_series);
+  close(fd);
+
+  print_phase(disk, "Wrote", &r->write);
+
+  fd = open_direct(r->path, O_RDONLY, &r->direct);
+
+  /* without O_DIRECT, reads would come from the page cache */
+  if (!r->direct)
+    checkSyscall("posix_fadvise()", -posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED));
+
+#pragma omp barrier
+#pragma omp single
+  printf("Reading...\n");
+
+  run_phase(r, &u, 0, fd, b, buffers, read_series);
+  close(fd);
+
+  print_phase(disk, "Read", &r->read);
+
+  /* Teardown */
+  if (!keep)
+    checkSyscall("unlink()", unlink(r->path));
+
+  for (i = 0; i < b->queue_depth; i++)
+    free(buffers[i]);
+
+  if (r->engine == ENGINE_URING)
+    uring_destroy(&u);
+}
+
+void usage(const char *progname) {
+  printf("Usage: %s [options] file...\n", progname);
+  printf("       %s -?\n", progname);
+  printf("\n");
+  printf("Writes and then reads a file on every disk, all disks at the same time.\n");
+  printf("\n");
+  printf("  -s      Size of each file, in GiB [100].\n");
+  printf("  -b      Block size, in KiB [1024].\n");
+  printf("  -q      Number of requests in flight per disk, for -e io_uring [32].\n");
+  printf("  -e      I/O engine: io_uring or sync (pwrite()/pread()) [io_uring].\n");
+  printf("  -k      Keep the files.\n");
+  printf("  -o      Write the results, including the throughput of every disk over time, to this file.\n");
+  printf("  -O      Format of the results: json or csv [json].\n");
+  printf("  -i      Interval between throughput samples, in ms, for -o [1000].\n");
+  printf("  -h      Show this help.\n");
+}
+
+int main(int argc, char **argv) {
+  /* What to run. */
+  struct bench bench = { 100UL * 1024 * 1024 * 1024, 1024 * 1024, 32, ENGINE_URING };
+  /* Keep the files after the test. */
+  int keep = 0;
+  /* Structured output, if outputFile is set. */
+  const char *outputFile = NULL;
+  output_format_t outputFormat = OUTPUT_JSON;
+  int intervalMs = 1000;
+
+  int opt, i;
+
+  /* parse command-line options */
+  while ((opt = getopt(argc, argv, "s:b:q:e:ko:O:i:h")) != -1) {
+    switch (opt) {
+    case 's':
+      bench.file_size = (size_t)(atof(optarg) * 1024 * 1024 * 1024);
+      break;
+
+    case 'b':
+      bench.block_size = atol(optarg) * 1024;
+      if (bench.block_size == 0 || bench.block_size % DIRECT_ALIGN) {
+        printf("Block size must be a multiple of %d KiB.\n", DIRECT_ALIGN / 1024);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'q':
+      bench.queue_depth = atoi(optarg);
+      if (bench.queue_depth < 1 || bench.queue_depth > 4096) {
+        printf("Queue depth must be between 1 and 4096.\n");
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'e':
+      if (parse_engine(optarg, &bench.engine) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'k':
+      keep = 1;
+      break;
+
+    case 'o':
+      outputFile = optarg;
+      break;
+
+    case 'O':
+      if (parse_output_format(optarg, &outputFormat) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'i':
+      intervalMs = atoi(optarg);
+      if (intervalMs < 1) {
+        printf("Sample interval must be at least 1 ms.\n");
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'h':
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+
+    default: /* '?' */
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  const int nrDisks = argc - optind;
+
+  if (nrDisks < 1 || nrDisks > MAX_DISKS) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* whole blocks only */
+  bench.file_size = bench.file_size / bench.block_size * bench.block_size;
+
+  if (bench.file_size == 0) {
+    printf("File size must be at least one block.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (bench.engine == ENGINE_SYNC)
+    bench.queue_depth = 1;
+
+  struct report reports[nrDisks];
+  memset(reports, 0, sizeof reports);
+
+  /* print configuration */
+  printf("File size:   %.2f GByte\n", bench.file_size / GBYTE);
+  printf("Block size:  %lu KByte\n", bench.block_size / 1024);
+  printf("Engine:      %s, %u requests in flight\n", engine_name(bench.engine), bench.queue_depth);
+
+  for (i = 0; i < nrDisks; i++) {
+    reports[i].path = argv[optind + i];
+    reports[i].node = path_node(reports[i].path);
+
+    printf("Disk %d:      %s (NUMA node %d)\n", i, reports[i].path, reports[i].node);
+  }
+
+  /* time series of the writes and reads of every disk */
+  struct sampler sampler;
+  struct series *series = NULL;
+
+  if (outputFile) {
+    sampler_init(&sampler, 2 * nrDisks, intervalMs, "error");
+    series = sampler.series;
+
+    for (i = 0; i < nrDisks; i++) {
+      snprintf(series[2 * i].name, sizeof series[2 * i].name, "disk %d write", i);
+      snprintf(series[2 * i + 1].name, sizeof series[2 * i + 1].name, "disk %d read", i);
+    }
+
+    sampler_start(&sampler);
+  }
+
+  /* test all disks in parallel */
+  omp_set_num_threads(nrDisks);
+
+#pragma omp parallel num_threads(nrDisks)
+  {
+    const int disk = omp_get_thread_num();
+
+    test_disk(&reports[disk], disk, &bench, keep, series ? &series[2 * disk] : NULL, series ? &series[2 * disk + 1] : NULL);
+  }
+
+  if (outputFile)
+    sampler_stop(&sampler);
+
+  /* calculate and show summary */
+  printf(" ----- Test results -----\n");
+  double totalWrite = 0.0, totalRead = 0.0, minWrite = 0.0, minRead = 0.0;
+  struct histogram writeLatency, readLatency;
+
+  hist_init(&writeLatency);
+  hist_init(&readLatency);
+
+  for (i = 0; i < nrDisks; i++) {
+    const double write_mbps = reports[i].write.nr_bytes / MBYTE / reports[i].write.seconds;
+    const double read_mbps  = reports[i].read.nr_bytes / MBYTE / reports[i].read.seconds;
+
+    totalWrite += write_mbps; /* sum */
+    totalRead  += read_mbps; /* sum */
+
+    if (i == 0 || write_mbps < minWrite) minWrite = write_mbps; /* min */
+    if (i == 0 || read_mbps < minRead)   minRead = read_mbps; /* min */
+
+    hist_merge(&writeLatency, &reports[i].write.latency);
+    hist_merge(&readLatency, &reports[i].read.latency);
+
+    printf("Disk %d:      write %.1f MB/s, read %.1f MB/s, %s%s\n", i, write_mbps, read_mbps, engine_name(reports[i].engine), reports[i].direct ? ", O_DIRECT" : "");
+  }
+
+  printf("Test version:  %s\n", VERSION);
+  printf("Total write:   %.1f MB/s (slowest disk %.1f MB/s)\n", totalWrite, minWrite);
+  printf("Total read:    %.1f MB/s (slowest disk %.1f MB/s)\n", totalRead, minRead);
+  hist_print("Write latency:", &writeLatency, 1e6, "ms");
+  hist_print("Read latency: ", &readLatency, 1e6, "ms");
+
+  if (outputFile) {
+    const struct summary_value summary[] = {
+      { "disks",              nrDisks },
+      { "total_write_mbps",   totalWrite },
+      { "total_read_mbps",    totalRead },
+      { "min_write_mbps",     minWrite },
+      { "min_read_mbps",      minRead },
+      { "write_p99_ms",       hist_percentile(&writeLatency, 99.0) / 1e6 },
+      { "read_p99_ms",        hist_percentile(&readLatency, 99.0) / 1e6 },
+    };
+
+    /* see Compliance in README.md */
+    const int pass = minWrite >= 80.0 && minRead >= 100.0;
+
+    sampler_write(&sampler, outputFile, outputFormat, "disk-bench", summary, sizeof summary / sizeof summary[0], pass,
+                  "every disk >= 80 MB/s write and >= 100 MB/s read");
+    sampler_destroy(&sampler);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "disk-io.h"
+
+int uring_init(struct uring *u, unsigned entries) {
+  struct io_uring_params p;
+
+  memset(u, 0, sizeof *u);
+  memset(&p, 0, sizeof p);
+
+  u->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (u->fd < 0)
+    return -1;
+
+  u->entries   = p.sq_entries;
+  u->sq_size   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cq_size   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  /* newer kernels map both rings at once */
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_size > u->sq_size)
+      u->sq_size = u->cq_size;
+    u->cq_size = u->sq_size;
+  }
+
+  u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (u->sq_ptr == MAP_FAILED) {
+    close(u->fd);
+    return -1;
+  }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    u->cq_ptr = u->sq_ptr;
+  } else {
+    u->cq_ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    checkSyscall("mmap(IORING_OFF_CQ_RING)", u->cq_ptr == MAP_FAILED ? -1 : 0);
+  }
+
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  checkSyscall("mmap(IORING_OFF_SQES)", u->sqes == MAP_FAILED ? -1 : 0);
+
+  u->sq_head  = (unsigned *)((char *)u->sq_ptr + p.sq_off.head);
+  u->sq_tail  = (unsigned *)((char *)u->sq_ptr + p.sq_off.tail);
+  u->sq_mask  = (unsigned *)((char *)u->sq_ptr + p.sq_off.ring_mask);
+  u->sq_array = (unsigned *)((char *)u->sq_ptr + p.sq_off.array);
+
+  u->cq_head  = (unsigned *)((char *)u->cq_ptr + p.cq_off.head);
+  u->cq_tail  = (unsigned *)((char *)u->cq_ptr + p.cq_off.tail);
+  u->cq_mask  = (unsigned *)((char *)u->cq_ptr + p.cq_off.ring_mask);
+  u->cqes     = (struct io_uring_cqe *)((char *)u->cq_ptr + p.cq_off.cqes);
+
+  return 0;
+}
+
+void uring_destroy(struct uring *u) {
+  munmap(u->sqes, u->sqes_size);
+  if (u->cq_ptr != u->sq_ptr)
+    munmap(u->cq_ptr, u->cq_size);
+  munmap(u->sq_ptr, u->sq_size);
+  close(u->fd);
+}
+
+void uring_prep(struct uring *u, int opcode, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data) {
+  /* only we write the tail */
+  const unsigned tail = *u->sq_tail;
+  const unsigned index = tail & *u->sq_mask;
+  struct io_uring_sqe *sqe = &u->sqes[index];
+
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode    = opcode;
+  sqe->fd        = fd;
+  sqe->addr      = (uintptr_t)buf;
+  sqe->len       = len;
+  sqe->off       = offset;
+  sqe->user_data = user_data;
+
+  u->sq_array[index] = index;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void uring_submit(struct uring *u, unsigned nr_queued, unsigned wait_nr) {
+  int result;
+
+  do {
+    result = syscall(__NR_io_uring_enter, u->fd, nr_queued, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while (result < 0 && errno == EINTR);
+
+  checkSyscall("io_uring_enter()", result);
+}
+
+int uring_reap(struct uring *u, uint64_t *user_data, int *res) {
+  /* only we write the head */
+  const unsigned head = *u->cq_head;
+
+  if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+    return 0;
+
+  const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+
+  *user_data = cqe->user_data;
+  *res       = cqe->res;
+
+  __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+int open_direct(const char *path, int flags, int *direct) {
+  int fd = open(path, flags | O_DIRECT, 0644);
+
+  *direct = 1;
+
+  if (fd < 0 && errno == EINVAL) {
+    /* f.e. tmpfs */
+    *direct = 0;
+    fd = open(path, flags, 0644);
+  }
+
+  if (fd < 0) {
+    printf("ERROR: Could not open %s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  return fd;
+}
+
+void *alloc_direct(size_t size) {
+  void *ptr;
+
+  if (posix_memalign(&ptr, DIRECT_ALIGN, size) != 0) {
+    printf("ERROR: Could not allocate %lu bytes.\n", size);
+    exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+int path_node(const char *path) {
+  struct stat st;
+  char sysfs[128];
+  FILE *f;
+  int node = -1;
+
+  if (stat(path, &st) < 0)
+    return -1;
+
+  /* the device of a partition is found through its parent disk */
+  snprintf(sysfs, sizeof sysfs, "/sys/dev/block/%u:%u/device/numa_node", major(st.st_dev), minor(st.st_dev));
+  if (!(f = fopen(sysfs, "r"))) {
+    snprintf(sysfs, sizeof sysfs, "/sys/dev/block/%u:%u/../device/numa_node", major(st.st_dev), minor(st.st_dev));
+    f = fopen(sysfs, "r");
+  }
+
+  if (!f)
+    return -1;
+
+  if (fscanf(f, "%d", &node) != 1)
+    node = -1;
+
+  fclose(f);
+  return node;
+}
+
+const char *engine_name(engine_t engine) {
+  switch (engine) {
+    case ENGINE_URING: return "io_uring";
+    case ENGINE_SYNC:  return "sync";
+  }
+
+  return "???";
+}
+
+int parse_engine(const char *name, engine_t *engine) {
+  if (!strcmp(name, "io_uring"))
+    *engine = ENGINE_URING;
+  else if (!strcmp(name, "sync"))
+    *engine = ENGINE_SYNC;
+  else
+    return -1;
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef __DISK_IO__
+#define __DISK_IO__
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Alignment of buffers, offsets and sizes for O_DIRECT. */
+#define DIRECT_ALIGN  4096
+
+/* How to submit I/O. */
+typedef enum {
+  ENGINE_URING,  /* io_uring, with many requests in flight */
+  ENGINE_SYNC    /* pwrite()/pread(), one request at a time */
+} engine_t;
+
+/* An io_uring, set up with the raw system calls, as liburing is not required. */
+struct uring {
+  int fd;
+  unsigned entries;
+
+  /* submission queue */
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  struct io_uring_sqe *sqes;
+
+  /* completion queue */
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *sq_ptr, *cq_ptr;
+  size_t sq_size, cq_size, sqes_size;
+};
+
+/* Set up an io_uring with room for `entries' requests. Returns 0 on success, or
+ * -1 if the kernel does not support (or allows) io_uring, with errno set. */
+int uring_init(struct uring *u, unsigned entries);
+
+void uring_destroy(struct uring *u);
+
+/* Queue a read or write (opcode IORING_OP_READ or IORING_OP_WRITE) of `len' bytes
+ * at `offset' of fd. The request is submitted by the next uring_submit(). */
+void uring_prep(struct uring *u, int opcode, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data);
+
+/* Submit the queued requests, and wait until at least `wait_nr' have completed. */
+void uring_submit(struct uring *u, unsigned nr_queued, unsigned wait_nr);
+
+/* Take a completion. Returns 1 if there was one, 0 otherwise. */
+int uring_reap(struct uring *u, uint64_t *user_data, int *res);
+
+/* Open `path' with O_DIRECT added to `flags'. If the file system does not support
+ * O_DIRECT, the file is opened without it, and *direct is set to 0. Exits on error. */
+int open_direct(const char *path, int flags, int *direct);
+
+/* Allocate `size' bytes aligned for O_DIRECT. Exits on error. */
+void *alloc_direct(size_t size);
+
+/* Return the NUMA node of the disk holding `path', or -1 if unknown. */
+int path_node(const char *path);
+
+const char *engine_name(engine_t engine);
+
+/* Parse a name into an engine. Return 0 on success, -1 if the name is unknown. */
+int parse_engine(const char *name, engine_t *engine);
+
+#endif
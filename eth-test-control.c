@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <endian.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+#include "eth-test-control.h"
+
+static struct addrinfo *resolve_tcp(const char *hostStr, unsigned short port) {
+  struct addrinfo hints, *ai;
+  char portStr[10];
+  int result;
+
+  snprintf(portStr, sizeof portStr, "%d", port);
+
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family   = AF_INET; /* IPv4 */
+  hints.ai_flags    = AI_NUMERICSERV; /* numerical ports only */
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  if ((result = getaddrinfo(hostStr, portStr, &hints, &ai)) != 0) {
+    printf("getaddrinfo(\"%s\") failed: %s\n", hostStr, gai_strerror(result));
+    exit(EXIT_FAILURE);
+  }
+
+  return ai;
+}
+
+/* the messages are small and strictly alternate, so do not delay them */
+static void set_nodelay(int fd) {
+  const int on = 1;
+
+  checkSyscall("setsockopt(TCP_NODELAY)",
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on));
+}
+
+int control_accept(const char *hostStr, unsigned short port) {
+  struct addrinfo *ai = resolve_tcp(hostStr, port);
+  const int on = 1;
+  int listen_fd, fd;
+
+  checkSyscall("socket()",
+    listen_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+  checkSyscall("setsockopt(SO_REUSEADDR)",
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on));
+  checkSyscall("bind()",
+    bind(listen_fd, ai->ai_addr, ai->ai_addrlen));
+  checkSyscall("listen()",
+    listen(listen_fd, 1));
+
+  freeaddrinfo(ai);
+
+  checkSyscall("accept()",
+    fd = accept(listen_fd, NULL, NULL));
+  close(listen_fd);
+
+  set_nodelay(fd);
+  return fd;
+}
+
+int control_connect(const char *hostStr, unsigned short port) {
+  struct addrinfo *ai = resolve_tcp(hostStr, port);
+  int fd;
+
+  checkSyscall("socket()",
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+  checkSyscall("connect()",
+    connect(fd, ai->ai_addr, ai->ai_addrlen));
+
+  freeaddrinfo(ai);
+
+  set_nodelay(fd);
+  return fd;
+}
+
+void control_send(int fd, const void *msg, size_t size) {
+  uint64_t fields[size / sizeof(uint64_t)];
+  size_t i, done = 0;
+
+  memcpy(fields, msg, size);
+  for (i = 0; i < size / sizeof(uint64_t); i++) {
+    fields[i] = htobe64(fields[i]);
+  }
+
+  while (done < size) {
+    ssize_t n;
+
+    checkSyscall("send()",
+      n = send(fd, (const char *)fields + done, size - done, MSG_NOSIGNAL));
+    done += n;
+  }
+}
+
+int control_recv(int fd, void *msg, size_t size) {
+  uint64_t fields[size / sizeof(uint64_t)];
+  size_t i, done = 0;
+
+  while (done < size) {
+    ssize_t n;
+
+    checkSyscall("recv()",
+      n = recv(fd, (char *)fields + done, size - done, 0));
+    if (n == 0)
+      return 0;
+
+    done += n;
+  }
+
+  for (i = 0; i < size / sizeof(uint64_t); i++) {
+    fields[i] = be64toh(fields[i]);
+  }
+  memcpy(msg, fields, size);
+
+  return 1;
+}
@@ -0,0 +1,56 @@
+#ifndef __ETH_TEST_CONTROL__
+#define __ETH_TEST_CONTROL__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A TCP connection between eth-test-send and eth-test-receive, over which the sender
+ * runs a series of trials. Per trial, the sender sends a struct trial, the receiver
+ * binds its ports and answers with a struct trial_ready, the sender sends the packets
+ * and end-of-stream markers, and the receiver answers with a struct trial_result.
+ * A trial of 0 ports ends the series.
+ *
+ * All messages consist of 64-bit fields, sent in network byte order.
+ */
+
+/* Default TCP port of the control connection. */
+#define CONTROL_PORT 4999
+
+/* Smallest packet size of a trial: a header and a CRC32C. */
+#define MIN_MSGSIZE 64
+
+/* Maximum number of ports of a trial. */
+#define MAX_TRIAL_PORTS 64
+
+struct trial {
+  uint64_t nr_ports;     /* starting at the first port of the receiver */
+  uint64_t msg_size;     /* bytes per packet, at most MAX_MSGSIZE */
+  uint64_t nr_packets;   /* per port, numbered 1 to nr_packets */
+  uint64_t verify;       /* payloads carry a pattern and CRC32C */
+};
+
+struct trial_ready {
+  uint64_t nr_ports;     /* ports bound */
+};
+
+struct trial_result {
+  uint64_t expected;     /* packets, over all ports */
+  uint64_t received;     /* unique packets received */
+  uint64_t corrupt;      /* packets that failed verification */
+  uint64_t nr_bytes;     /* bytes received */
+  uint64_t duration_ns;  /* from the first to the last arrival, over all ports */
+};
+
+/* Listen for the sender on hostStr:port, and return the connection once it arrives. */
+int control_accept(const char *hostStr, unsigned short port);
+
+/* Connect to the receiver at hostStr:port, and return the connection. */
+int control_connect(const char *hostStr, unsigned short port);
+
+/* Send the struct at `msg' of `size' bytes, which consists of 64-bit fields. */
+void control_send(int fd, const void *msg, size_t size);
+
+/* Receive a struct of `size' bytes into `msg'. Returns 0 if the connection closed, 1 otherwise. */
+int control_recv(int fd, void *msg, size_t size);
+
+#endif
@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+#include "eth-test-payload.h"
+#include "eth-test-receive.h"
+#include "eth-test-send.h"
+
+/* Move the calling thread into network namespace `name' (see ip-netns(8)). */
+static void enter_netns(const char *name) {
+  char path[1024];
+  int fd;
+
+  snprintf(path, sizeof path, "/var/run/netns/%s", name);
+  checkSyscall("open(netns)", fd = open(path, O_RDONLY | O_CLOEXEC));
+  checkSyscall("setns()", setns(fd, CLONE_NEWNET));
+  close(fd);
+}
+
+void usage(const char *progname) {
+  printf("Usage: %s [options]\n", progname);
+  printf("       %s -?\n", progname);
+  printf("\n");
+  printf("  -H      Host name (or IP address) to send to and receive on [127.0.0.1].\n");
+  printf("  -P      First port number to receive on [5000].\n");
+  printf("  -N      Network namespace to receive in, f.e. the far end of a veth pair [none].\n");
+  printf("  -s      Speed per port, in Mbit/s [%.0f].\n", SPEED_BITS_PER_SEC / 1e6);
+  printf("  -M      Send engine: single (one sendmsg() per packet), bucket (paced sendmmsg())\n");
+  printf("          or wheel (all ports from a few threads, scheduled on a timing wheel) [bucket].\n");
+  printf("  -w      Number of threads sending to the ports, each pinned to a CPU, for -M wheel [1, max %d].\n", MAX_WHEELS);
+  printf("  -b      Maximum number of packets per sendmmsg() call [%d].\n", MSG_BATCHSIZE);
+  printf("  -G      Send up to this many packets per super-packet (UDP GSO), for -M bucket [1, max %d].\n", (int)MAX_GSO_SEGS);
+  printf("  -g      Let the kernel coalesce packets (UDP GRO).\n");
+  printf("  -W      Wait for packets by: block (sleep in recvmmsg()) or busy (poll without sleeping) [block].\n");
+  printf("  -T      Give up on a port after this many ms without packets [%d].\n", IDLE_TIMEOUT_MS);
+  printf("  -V      Fill the payloads with a pattern and a CRC32C, and verify them.\n");
+  printf("  -t      Timestamp packets to measure latency: none or sw (kernel) [none].\n");
+  printf("  -h      Show this help.\n");
+}
+
+int main(int argc, char **argv) {
+  /* Host to send to and receive on. */
+  const char *hostStr = "127.0.0.1";
+  /* First port to listen on. */
+  int firstPort = 5000;
+  /* Number of ports to listen on. */
+  const int nrPorts = NR_PORTS;
+  /* Network namespace of the receivers, or NULL for our own. */
+  const char *netns = NULL;
+  /* Speed per port, in bits/s. */
+  double speedBps = SPEED_BITS_PER_SEC;
+  /* Engine to send with. */
+  send_engine_t engine = BUCKET;
+  /* Number of threads for the wheel engine. */
+  int nrWheels = 1;
+  /* Maximum number of packets per send call. */
+  int maxBatch = MSG_BATCHSIZE;
+  /* Number of packets per GSO super-packet. */
+  int gsoSegs = 1;
+  /* Receive coalesced packets. */
+  int gro = 0;
+  /* How to wait for packets. */
+  wait_mode_t wait = WAIT_BLOCK;
+  /* Time without packets after which a port ends, in ms. */
+  int idleMs = IDLE_TIMEOUT_MS;
+  /* Source of packet timestamps. */
+  timestamp_t timestamps = TS_NONE;
+  /* Fill and verify the payloads. */
+  int verify = 0;
+
+  int i, opt;
+
+  /* parse command-line options */
+  while ((opt = getopt(argc, argv, "H:P:N:s:M:w:b:G:gW:T:Vt:h")) != -1) {
+    switch (opt) {
+    case 'H':
+      hostStr = strdup(optarg);
+      break;
+
+    case 'P':
+      firstPort = atoi(optarg);
+      break;
+
+    case 'N':
+      netns = optarg;
+      break;
+
+    case 's':
+      speedBps = atof(optarg) * 1e6;
+      if (speedBps <= 0.0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'M':
+      if (!strcmp(optarg, "single")) {
+        engine = SINGLE;
+      } else if (!strcmp(optarg, "bucket")) {
+        engine = BUCKET;
+      } else if (!strcmp(optarg, "wheel")) {
+        engine = WHEEL;
+      } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'w':
+      nrWheels = atoi(optarg);
+      if (nrWheels < 1 || nrWheels > MAX_WHEELS) {
+        printf("Number of wheel threads must be between 1 and %d.\n", MAX_WHEELS);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'b':
+      maxBatch = atoi(optarg);
+      if (maxBatch < 1 || maxBatch > MSG_BATCHSIZE) {
+        printf("Batch size must be between 1 and %d.\n", MSG_BATCHSIZE);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'G':
+      gsoSegs = atoi(optarg);
+      if (gsoSegs < 1 || gsoSegs > MAX_GSO_SEGS) {
+        printf("Number of GSO segments must be between 1 and %d.\n", (int)MAX_GSO_SEGS);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'g':
+      gro = 1;
+      break;
+
+    case 'W':
+      if (!strcmp(optarg, "block")) {
+        wait = WAIT_BLOCK;
+      } else if (!strcmp(optarg, "busy")) {
+        wait = WAIT_BUSY;
+      } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'T':
+      idleMs = atoi(optarg);
+      if (idleMs < 1) {
+        printf("Idle timeout must be at least 1 ms.\n");
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'V':
+      verify = 1;
+      break;
+
+    case 't':
+      if (!strcmp(optarg, "none")) {
+        timestamps = TS_NONE;
+      } else if (!strcmp(optarg, "sw")) {
+        timestamps = TS_SOFTWARE;
+      } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'h':
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+
+    default: /* '?' */
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* print configuration */
+  printf("Target host: %s%s%s\n", hostStr, netns ? " in namespace " : "", netns ? netns : "");
+  printf("First port:  %d\n", firstPort);
+  printf("Port count:  %d\n", nrPorts);
+  printf("Speed:       %.2f Gbit/s per port\n", speedBps / 1e9);
+  printf("Engine:      %s\n", engine == SINGLE ? "single" : engine == BUCKET ? "bucket" : "wheel");
+  if (engine == WHEEL)
+    printf("Threads:     %d\n", nrWheels);
+  if (engine == BUCKET) {
+    printf("Max batch:   %d\n", maxBatch);
+    printf("GSO:         %d packets/super-packet\n", gsoSegs);
+  }
+  printf("GRO:         %s\n", gro ? "yes" : "no");
+  printf("Wait:        %s\n", wait == WAIT_BUSY ? "busy polling" : "blocking");
+  if (verify)
+    printf("Verify:      CRC32C (%s) at %.2f GByte/s per core\n", crc32c_name(), crc32c_speed() / GBYTE);
+
+  /* a receiver thread per port, and a sender thread per port or per wheel, which all start
+   * sending once all receivers are bound */
+  struct report reports[nrPorts];
+  struct send_report sendReports[nrPorts];
+  const int nrSenders = engine == WHEEL ? nrWheels : nrPorts;
+
+  omp_set_num_threads(nrPorts + nrSenders);
+
+#pragma omp parallel num_threads(nrPorts + nrSenders)
+  {
+    const int thread = omp_get_thread_num();
+
+    if (thread < nrPorts) {
+      if (netns)
+        enter_netns(netns);
+
+      reports[thread] = receive_data(hostStr, firstPort + thread, timestamps, gro, verify, wait, idleMs, NULL, NULL, 0);
+    } else if (engine == WHEEL) {
+      wheel_thread(hostStr, firstPort, nrPorts, thread - nrPorts, nrWheels, speedBps, MAX_MSGSIZE, NR_PACKETS_SENT, maxBatch, verify, sendReports);
+    } else {
+      const int port = thread - nrPorts;
+
+      sendReports[port] = engine == SINGLE
+                        ? send_single(hostStr, firstPort + port, speedBps, verify)
+                        : send_bucket(hostStr, firstPort + port, speedBps, maxBatch, 1, gsoSegs, verify);
+    }
+  }
+
+  /* calculate and show summary */
+  for ( i = 0; i < nrPorts; i++ ) {
+    printf("Port %d: sent %.2f Gbit/s, received %.2f Gbit/s using %.1f%% CPU, lost %ld of %ld packets, %ld corrupt, %ld not accepted by the sending socket\n",
+      firstPort + i,
+      sendReports[i].speed_gbps,
+      reports[i].speed_gbps,
+      reports[i].cpu_perc,
+      reports[i].seq.lost,
+      reports[i].seq.expected,
+      reports[i].corrupt,
+      sendReports[i].send_errors);
+  }
+
+  if (engine == WHEEL)
+    wheel_print(sendReports, firstPort, nrPorts, speedBps);
+
+  send_summary(sendReports, nrPorts, speedBps);
+  receive_summary(reports, nrPorts, 0, verify);
+
+  printf("Done.\n");
+
+  return EXIT_SUCCESS;
+}
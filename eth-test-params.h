@@ -2,6 +2,7 @@
 #define __ETH_TEST_PARAMS__
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* How many batches of UDP messages to send/receive. */
 #define NR_BATCHES    512
@@ -23,9 +24,20 @@
  */
 #define NR_PORTS      12
 
+/* Packet number of the end-of-stream markers sent after the data. Their
+ * send_time holds the number of the last packet sent instead. */
+#define EOS_PACKET_NR ((size_t)-1)
+
+/* Number of end-of-stream markers sent, as some may be lost. */
+#define EOS_MARKERS   3
+
+/* Time without packets after which a receiver gives up on a port, in ms. */
+#define IDLE_TIMEOUT_MS 1000
+
 struct message {
     size_t packet_nr; /* incrementing packet number, used to detect loss. */
-    char payload[MAX_MSGSIZE - sizeof(size_t)];
+    uint64_t send_time; /* time of sending, in ns since the epoch of the sender's clock. */
+    char payload[MAX_MSGSIZE - sizeof(size_t) - sizeof(uint64_t)];
 };
 
 #endif
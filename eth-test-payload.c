@@ -0,0 +1,164 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "common.h"
+#include "eth-test-payload.h"
+
+/* Reflected CRC32C polynomial. */
+#define CRC32C_POLY 0x82f63b78
+
+/* Tables for slicing-by-8: table[k][b] is the CRC of byte b followed by k zero bytes. */
+static uint32_t table[8][256];
+
+static uint32_t (*crc32c_update)(uint32_t crc, const uint8_t *p, size_t len);
+static const char *crc32c_impl;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_software(uint32_t crc, const uint8_t *p, size_t len) {
+  /* process 8 bytes per step */
+  while (len >= 8) {
+    uint64_t word;
+
+    memcpy(&word, p, sizeof word);
+    word ^= crc;
+
+    crc = table[7][ word        & 0xff] ^ table[6][(word >>  8) & 0xff]
+        ^ table[5][(word >> 16) & 0xff] ^ table[4][(word >> 24) & 0xff]
+        ^ table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff]
+        ^ table[1][(word >> 48) & 0xff] ^ table[0][ word >> 56        ];
+
+    p   += 8;
+    len -= 8;
+  }
+
+  while (len--)
+    crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+  return crc;
+}
+
+#ifdef __x86_64__
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len) {
+  uint64_t crc64 = crc;
+
+  while (len >= 8) {
+    uint64_t word;
+
+    memcpy(&word, p, sizeof word);
+    crc64 = _mm_crc32_u64(crc64, word);
+
+    p   += 8;
+    len -= 8;
+  }
+
+  crc = crc64;
+  while (len--)
+    crc = _mm_crc32_u8(crc, *p++);
+
+  return crc;
+}
+#endif /* __x86_64__ */
+
+static void crc32c_init(void) {
+  int b, k;
+
+  for (b = 0; b < 256; b++) {
+    uint32_t crc = b;
+
+    for (k = 0; k < 8; k++)
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+
+    table[0][b] = crc;
+  }
+
+  for (b = 0; b < 256; b++) {
+    for (k = 1; k < 8; k++)
+      table[k][b] = table[0][table[k - 1][b] & 0xff] ^ (table[k - 1][b] >> 8);
+  }
+
+  crc32c_update = crc32c_software;
+  crc32c_impl   = "software";
+
+#ifdef __x86_64__
+  if (__builtin_cpu_supports("sse4.2")) {
+    crc32c_update = crc32c_sse42;
+    crc32c_impl   = "sse4.2";
+  }
+#endif
+}
+
+uint32_t crc32c(const void *data, size_t len) {
+  pthread_once(&crc32c_once, crc32c_init);
+
+  return ~crc32c_update(~0U, data, len);
+}
+
+const char *crc32c_name(void) {
+  pthread_once(&crc32c_once, crc32c_init);
+
+  return crc32c_impl;
+}
+
+double crc32c_speed(void) {
+  const size_t size = 1024 * 1024;
+  char *buffer = malloc(size);
+  volatile uint32_t sink = 0;
+  size_t nr_bytes = 0;
+
+  memset(buffer, 0x5a, size);
+  (void)crc32c(buffer, size); /* warm up */
+
+  /* run for about 100 ms */
+  const uint64_t begin = now_ns();
+  uint64_t end;
+
+  do {
+    sink ^= crc32c(buffer, size);
+    nr_bytes += size;
+    end = now_ns();
+  } while (end - begin < 100000000);
+
+  (void)sink;
+  free(buffer);
+
+  return nr_bytes / ((end - begin) / 1e9);
+}
+
+void payload_fill(struct message *m, size_t len) {
+  char *packet = (char *)m;
+  const size_t end = len - sizeof(uint32_t);
+  size_t offset;
+
+  /* xorshift64, seeded by the packet number */
+  uint64_t x = (m->packet_nr + 1) * PAYLOAD_SEED;
+
+  for (offset = offsetof(struct message, payload); offset + 8 <= end; offset += 8) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    memcpy(packet + offset, &x, sizeof x);
+  }
+
+  memset(packet + offset, 0, end - offset);
+
+  const uint32_t crc = crc32c(packet, end);
+  memcpy(packet + end, &crc, sizeof crc);
+}
+
+int payload_verify(const void *packet, size_t len) {
+  uint32_t crc;
+
+  if (len < offsetof(struct message, payload) + sizeof crc)
+    return 0;
+
+  memcpy(&crc, (const char *)packet + len - sizeof crc, sizeof crc);
+
+  return crc32c(packet, len - sizeof crc) == crc;
+}
@@ -0,0 +1,28 @@
+#ifndef __ETH_TEST_PAYLOAD__
+#define __ETH_TEST_PAYLOAD__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eth-test-params.h"
+
+/* Seed of the payload pattern. */
+#define PAYLOAD_SEED 0x9e3779b97f4a7c15ULL
+
+/* Return the CRC32C (Castagnoli) of `len' bytes, computed with SSE4.2 if this CPU supports it. */
+uint32_t crc32c(const void *data, size_t len);
+
+/* Name of the CRC32C implementation used: sse4.2 or software. */
+const char *crc32c_name(void);
+
+/* Measure the speed of crc32c() on the calling core, in bytes/s. */
+double crc32c_speed(void);
+
+/* Fill the payload of a packet of `len' bytes, of which packet_nr and send_time are
+ * set, with a pattern derived from packet_nr, and end it with the CRC32C of the rest. */
+void payload_fill(struct message *m, size_t len);
+
+/* Return whether the CRC32C at the end of a received packet of `len' bytes matches its contents. */
+int payload_verify(const void *packet, size_t len);
+
+#endif
@@ -0,0 +1,576 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netdb.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <linux/errqueue.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "eth-test-payload.h"
+#include "eth-test-receive.h"
+
+static int64_t ns(const struct timespec *ts) {
+  return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void port_init(struct port_state *p) {
+  memset(p, 0, sizeof *p);
+  pthread_spin_init(&p->lock, PTHREAD_PROCESS_PRIVATE);
+}
+
+int port_add(struct port_state *p, const size_t *packet_nrs, int n, int nr_corrupt, size_t nr_bytes, const struct timespec *now, size_t target) {
+  int completed = 0;
+  int i;
+
+  pthread_spin_lock(&p->lock);
+
+  if (!p->started && n == 0) {
+    /* we need a valid packet number to start with */
+    p->nr_corrupt += nr_corrupt;
+  } else if (!p->started) {
+    /* packets received along with the first one are accounted for, but not timed */
+    seq_window_init(&p->window, packet_nrs[0]);
+    for (i = 1; i < n; i++) {
+      seq_window_add(&p->window, packet_nrs[i]);
+    }
+
+    p->first = *now;
+    p->last  = *now;
+    p->started = 1;
+    mark_first_arrival(now);
+  } else if (!p->done) {
+    for (i = 0; i < n; i++) {
+      seq_window_add(&p->window, packet_nrs[i]);
+    }
+
+    p->nr_bytes   += nr_bytes;
+    p->nr_msgs    += n + nr_corrupt;
+    p->nr_corrupt += nr_corrupt;
+    p->last = *now;
+
+    series_update(p->series, p->nr_bytes, p->window.received + p->window.lost, p->window.lost);
+
+    if (p->nr_msgs >= target) {
+      p->done = 1;
+      completed = 1;
+    }
+  }
+
+  pthread_spin_unlock(&p->lock);
+
+  return completed;
+}
+
+int port_end(struct port_state *p, size_t last_packet_nr) {
+  int ended = 0;
+
+  pthread_spin_lock(&p->lock);
+
+  if (p->started && !p->done) {
+    seq_window_end(&p->window, last_packet_nr);
+    p->eos  = 1;
+    p->done = 1;
+    ended   = 1;
+  }
+
+  pthread_spin_unlock(&p->lock);
+
+  return ended;
+}
+
+int port_check_idle(struct port_state *p, const struct timespec *now, uint64_t idle_ns) {
+  int ended = 0;
+
+  pthread_spin_lock(&p->lock);
+
+  const int64_t idle = (now->tv_sec - p->last.tv_sec) * 1000000000LL + (now->tv_nsec - p->last.tv_nsec);
+
+  if (!p->done && (p->started ? idle > (int64_t)idle_ns : never_started(now, idle_ns))) {
+    p->timed_out = 1;
+    p->done      = 1;
+    ended        = 1;
+  }
+
+  pthread_spin_unlock(&p->lock);
+
+  return ended;
+}
+
+struct report port_report(struct port_state *p, unsigned short port) {
+  struct report result = { 0.0, 0.0 };
+  latency_init(&result.latency);
+
+  if (!p->started) {
+    report_all_lost(&result, (size_t)NR_BATCHES * MSG_BATCHSIZE);
+    result.corrupt   = p->nr_corrupt;
+    result.timed_out = p->timed_out;
+
+    printf("Port %d: No UDP packets arrived, lost all %ld messages, %ld corrupt.\n", port, result.seq.lost, result.corrupt);
+
+    pthread_spin_destroy(&p->lock);
+
+    return result;
+  }
+  const double seconds = (p->last.tv_sec - p->first.tv_sec) + (p->last.tv_nsec - p->first.tv_nsec) / 1e9;
+
+  result.seq        = seq_window_finish(&p->window);
+  result.corrupt    = p->nr_corrupt;
+  result.eos        = p->eos;
+  result.timed_out  = p->timed_out;
+  discount_corrupt(&result);
+  result.speed_gbps = p->nr_bytes / GBPS / seconds;
+  result.loss_perc  = 100.0 * result.seq.lost / result.seq.expected;
+  result.nr_bytes   = p->nr_bytes;
+
+  printf("Port %d: Received %.2f GByte over %.2f seconds. Speed: %.2f Gbit/s\n",
+    port,
+    p->nr_bytes/GBYTE,
+    seconds,
+    result.speed_gbps);
+  printf("Port %d: Received %ld messages, lost %ld of %ld messages (%ld late, %ld duplicate, %ld stale), longest burst %ld, %ld corrupt.\n",
+    port,
+    p->nr_msgs,
+    result.seq.lost,
+    result.seq.expected,
+    result.seq.late,
+    result.seq.duplicate,
+    result.seq.stale,
+    result.seq.max_burst,
+    result.corrupt);
+
+  if (p->eos)
+    printf("Port %d: The sender ended the stream early.\n", port);
+  if (p->timed_out)
+    printf("Port %d: The stream stopped without an end-of-stream marker.\n", port);
+
+  pthread_spin_destroy(&p->lock);
+
+  return result;
+}
+
+void discount_corrupt(struct report *r) {
+  /* corrupt packets are left out of the window, so they left a gap there */
+  r->seq.lost -= r->corrupt < r->seq.lost ? r->corrupt : r->seq.lost;
+}
+
+void report_all_lost(struct report *r, size_t expected) {
+  int bucket = 63 - __builtin_clzll(expected);
+
+  memset(&r->seq, 0, sizeof r->seq);
+  r->seq.expected  = expected;
+  r->seq.lost      = expected;
+  r->seq.max_burst = expected;
+  r->seq.burst_hist[bucket < SEQ_BURST_BUCKETS ? bucket : SEQ_BURST_BUCKETS - 1] = 1;
+
+  r->speed_gbps = 0.0;
+  r->loss_perc  = 100.0;
+  r->nr_bytes   = 0;
+}
+
+/* Arrival of the first packet on any port, in ns, or 0 if none arrived yet. */
+static int64_t first_arrival_ns = 0;
+
+void mark_first_arrival(const struct timespec *now) {
+  int64_t none = 0;
+
+  __atomic_compare_exchange_n(&first_arrival_ns, &none, ns(now), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+int never_started(const struct timespec *now, uint64_t idle_ns) {
+  const int64_t first = __atomic_load_n(&first_arrival_ns, __ATOMIC_RELAXED);
+
+  return first && ns(now) - first > (int64_t)idle_ns;
+}
+
+struct report receive_summary(const struct report *reports, int nr_reports, int recording, int verify) {
+  struct report totals = { 0.0, 0.0 };
+  int i;
+
+  printf(" ----- Test results -----\n");
+  latency_init(&totals.latency);
+  for ( i = 0; i < nr_reports; i++ ) {
+    totals.speed_gbps += reports[i].speed_gbps; /* sum */
+    totals.loss_perc  += reports[i].loss_perc / nr_reports; /* average */
+    totals.cpu_perc   += reports[i].cpu_perc; /* sum */
+    seq_stats_add(&totals.seq, &reports[i].seq); /* sum */
+    latency_merge(&totals.latency, &reports[i].latency); /* merge */
+    perf_values_add(&totals.perf, &reports[i].perf); /* sum */
+    totals.record.nr_bytes      += reports[i].record.nr_bytes; /* sum */
+    totals.record.dropped_msgs  += reports[i].record.dropped_msgs; /* sum */
+    totals.record.dropped_bytes += reports[i].record.dropped_bytes; /* sum */
+    if (reports[i].record.seconds > totals.record.seconds)
+      totals.record.seconds = reports[i].record.seconds; /* max */
+    if (reports[i].record.peak_buffers > totals.record.peak_buffers)
+      totals.record.peak_buffers = reports[i].record.peak_buffers; /* max */
+    totals.nr_bytes   += reports[i].nr_bytes; /* sum */
+    totals.corrupt    += reports[i].corrupt; /* sum */
+    totals.eos        += reports[i].eos; /* count */
+    totals.timed_out  += reports[i].timed_out; /* count */
+  }
+
+  printf("Test version: %s\n", VERSION);
+  printf("Total speed:  %.2f Gbit/s\n", totals.speed_gbps);
+  printf("Average loss: %.3f%%\n", totals.loss_perc);
+  if (totals.cpu_perc > 0.0)
+    printf("Receive CPU:  %.1f%% of a core\n", totals.cpu_perc);
+  printf("Total lost:   %ld of %ld packets\n", totals.seq.lost, totals.seq.expected);
+  printf("Total late:   %ld packets (reordered)\n", totals.seq.late);
+  printf("Duplicates:   %ld packets\n", totals.seq.duplicate);
+  printf("Stale:        %ld packets (older than %d packets)\n", totals.seq.stale, SEQ_WINDOW_SIZE);
+  if (verify)
+    printf("Corrupt:      %ld packets (CRC32C mismatch, not counted as lost)\n", totals.corrupt);
+  if (totals.eos || totals.timed_out)
+    printf("Ended early:  %d ports by the sender, %d ports stopped\n", totals.eos, totals.timed_out);
+  seq_stats_print_bursts("Loss ", &totals.seq);
+  if (totals.latency.one_way.total > 0)
+    latency_print("", &totals.latency);
+  perf_print("Counters:    ", &totals.perf, totals.nr_bytes);
+  if (recording) {
+    printf("Recorded:     %.2f GByte at %.1f MB/s\n", totals.record.nr_bytes/GBYTE, totals.record.seconds > 0.0 ? totals.record.nr_bytes/1e6/totals.record.seconds : 0.0);
+    printf("Peak buffers: %lu of %d in use\n", totals.record.peak_buffers, RECORD_BUFFERS);
+    printf("Not recorded: %lu datagrams (buffers full)\n", totals.record.dropped_msgs);
+  }
+
+  return totals;
+}
+
+void enable_timestamps(int fd, const char *hostStr, timestamp_t mode) {
+  const int on = 1;
+
+  switch (mode) {
+    case TS_NONE:
+      break;
+
+    case TS_SOFTWARE:
+      checkSyscall("setsockopt(SO_TIMESTAMPNS)",
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof on));
+      break;
+
+    case TS_HARDWARE: {
+      /* ask the NIC to timestamp all incoming packets */
+      struct hwtstamp_config config;
+      struct ifreq ifr;
+
+      memset(&config, 0, sizeof config);
+      config.tx_type   = HWTSTAMP_TX_OFF;
+      config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+      memset(&ifr, 0, sizeof ifr);
+      find_interface(hostStr, ifr.ifr_name, sizeof ifr.ifr_name);
+      ifr.ifr_data = (void *)&config;
+
+      if (ioctl(fd, SIOCSHWTSTAMP, &ifr) < 0)
+        printf("WARNING: Could not enable hardware timestamps on %s, falling back to software timestamps.\n", ifr.ifr_name);
+
+      /* software timestamps are needed for the kernel delay, and as a fallback */
+      const int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+                      | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+      checkSyscall("setsockopt(SO_TIMESTAMPING)",
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof flags));
+      break;
+    }
+  }
+}
+
+/* Clock the sender stamped the packets with. */
+clockid_t receive_clock = CLOCK_REALTIME;
+
+void latency_init(struct latency *l) {
+  struct timespec realtime, other;
+
+  clock_gettime(receive_clock, &other);
+  clock_gettime(CLOCK_REALTIME, &realtime);
+
+  hist_init(&l->one_way);
+  hist_init(&l->kernel_delay);
+  hist_init(&l->jitter);
+  l->nr_hardware    = 0;
+  l->software_offset = receive_clock == CLOCK_REALTIME ? 0 : ns(&other) - ns(&realtime);
+  l->prev_packet_nr = 0;
+  l->prev_transit   = 0;
+}
+
+void latency_add(struct latency *l, const struct msghdr *hdr, size_t packet_nr, uint64_t send_time, const struct timespec *now) {
+  struct timespec software = { 0, 0 }, hardware = { 0, 0 };
+  struct cmsghdr *cmsg;
+
+  for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *)hdr, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET)
+      continue;
+
+    if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(&software, CMSG_DATA(cmsg), sizeof software);
+    } else if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+      struct scm_timestamping ts;
+
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof ts);
+      software = ts.ts[0];
+      hardware = ts.ts[2];
+    }
+  }
+
+  const int has_software = software.tv_sec || software.tv_nsec;
+  const int has_hardware = hardware.tv_sec || hardware.tv_nsec;
+
+  if (!has_software && !has_hardware)
+    return;
+
+  /* software timestamps are on CLOCK_REALTIME, which differs from TAI by the leap seconds */
+  const int64_t transit = (has_hardware ? ns(&hardware) : ns(&software) + l->software_offset) - (int64_t)send_time;
+
+  hist_add(&l->one_way, transit);
+
+  if (has_hardware)
+    l->nr_hardware++;
+
+  if (has_software)
+    hist_add(&l->kernel_delay, ns(now) - ns(&software));
+
+  /* jitter does not depend on the clock offset between sender and receiver */
+  if (l->prev_packet_nr && packet_nr == l->prev_packet_nr + 1)
+    hist_add(&l->jitter, transit > l->prev_transit ? transit - l->prev_transit : l->prev_transit - transit);
+
+  l->prev_packet_nr = packet_nr;
+  l->prev_transit   = transit;
+}
+
+void latency_merge(struct latency *total, const struct latency *l) {
+  hist_merge(&total->one_way, &l->one_way);
+  hist_merge(&total->kernel_delay, &l->kernel_delay);
+  hist_merge(&total->jitter, &l->jitter);
+  total->nr_hardware += l->nr_hardware;
+}
+
+void latency_print(const char *prefix, const struct latency *l) {
+  char line[128];
+
+  snprintf(line, sizeof line, "%sLatency:     ", prefix);
+  hist_print(line, &l->one_way, 1e3, "us");
+  snprintf(line, sizeof line, "%sKernel delay:", prefix);
+  hist_print(line, &l->kernel_delay, 1e3, "us");
+  snprintf(line, sizeof line, "%sJitter:      ", prefix);
+  hist_print(line, &l->jitter, 1e3, "us");
+
+  if (l->one_way.negative)
+    printf("%s%ld packets arrived before they were sent: the clocks of sender and receiver are not synchronised.\n", prefix, l->one_way.negative);
+
+  printf("%sHardware timestamps: %ld of %ld packets\n", prefix, l->nr_hardware, l->one_way.total);
+}
+
+struct recv_batch *batch_alloc(int gro, timestamp_t timestamps, int verify) {
+  struct recv_batch *b = malloc(sizeof *b);
+  int i;
+
+  b->msg_size   = gro ? GRO_MSGSIZE : MAX_MSGSIZE;
+  b->timestamps = timestamps;
+  b->verify     = verify;
+  b->buffer     = malloc(MSG_BATCHSIZE * b->msg_size);
+  b->control    = malloc(MSG_BATCHSIZE * sizeof *b->control);
+
+  for( i = 0; i < MSG_BATCHSIZE; i++ ) {
+    b->iov[i].iov_base = b->buffer + i * b->msg_size;
+    b->iov[i].iov_len  = b->msg_size;
+    b->msgs[i].msg_hdr.msg_name    = NULL;
+    b->msgs[i].msg_hdr.msg_namelen = 0;
+    b->msgs[i].msg_hdr.msg_iov     = &b->iov[i];
+    b->msgs[i].msg_hdr.msg_iovlen  = 1;
+    b->msgs[i].msg_hdr.msg_control = NULL;
+    b->msgs[i].msg_hdr.msg_controllen = 0;
+    b->msgs[i].msg_hdr.msg_flags   = 0;
+  }
+
+  b->nr_packets = 0;
+  b->nr_corrupt = 0;
+  b->nr_bytes   = 0;
+
+  return b;
+}
+
+void batch_free(struct recv_batch *b) {
+  free(b->control);
+  free(b->buffer);
+  free(b);
+}
+
+/* Return the GRO segment size of a received message, or 0 if it was not coalesced. */
+static int gro_size(const struct msghdr *hdr) {
+  struct cmsghdr *cmsg;
+  int size = 0;
+
+  for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *)hdr, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+      memcpy(&size, CMSG_DATA(cmsg), sizeof size);
+  }
+
+  return size;
+}
+
+int batch_receive(struct recv_batch *b, int fd, int n, int flags, struct latency *latency) {
+  const int want_control = b->timestamps != TS_NONE || b->msg_size == GRO_MSGSIZE;
+  struct timespec now;
+  int i, num_msgs;
+
+  /* recvmmsg() overwrites the control data lengths */
+  if (want_control) {
+    for( i = 0; i < n; i++ ) {
+      b->msgs[i].msg_hdr.msg_control    = b->control[i];
+      b->msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+    }
+  }
+
+  b->nr_packets = 0;
+  b->nr_corrupt = 0;
+  b->eos        = 0;
+  b->nr_bytes   = 0;
+
+  num_msgs = recvmmsg(fd, &b->msgs[0], n, flags, NULL);
+  if (num_msgs <= 0)
+    return num_msgs;
+
+  if (latency && b->timestamps != TS_NONE)
+    clock_gettime(CLOCK_REALTIME, &now);
+
+  for( i = 0; i < num_msgs; i++ ) {
+    const struct msghdr *hdr = &b->msgs[i].msg_hdr;
+    const char *data = b->iov[i].iov_base;
+    const size_t len = b->msgs[i].msg_len;
+    size_t segment = want_control ? gro_size(hdr) : 0;
+    size_t offset;
+
+    if (segment == 0)
+      segment = len;
+
+    /* split coalesced messages into their packets */
+    for( offset = 0; offset < len && b->nr_packets < MAX_BATCH_PACKETS; offset += segment ) {
+      size_t packet_nr;
+      uint64_t send_time;
+
+      memcpy(&packet_nr, data + offset + offsetof(struct message, packet_nr), sizeof packet_nr);
+      memcpy(&send_time, data + offset + offsetof(struct message, send_time), sizeof send_time);
+
+      if (packet_nr == EOS_PACKET_NR) {
+        b->eos      = 1;
+        b->eos_last = send_time;
+        continue;
+      }
+
+      /* leave out corrupt packets, as their packet number cannot be trusted */
+      if (b->verify && !payload_verify(data + offset, len - offset < segment ? len - offset : segment)) {
+        b->nr_corrupt++;
+        continue;
+      }
+
+      b->packet_nrs[b->nr_packets++] = packet_nr;
+
+      if (latency && b->timestamps != TS_NONE)
+        latency_add(latency, hdr, packet_nr, send_time, &now);
+    }
+
+    b->nr_bytes += len;
+  }
+
+  return num_msgs;
+}
+
+void set_wait_mode(int fd, wait_mode_t mode) {
+  static int warned = 0;
+
+  if (mode == WAIT_BUSY) {
+    const int usecs = BUSY_POLL_USECS, on = 1, budget = BUSY_POLL_BUDGET;
+
+    /* raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN; we spin anyway */
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof usecs) < 0
+     && !__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+      printf("Could not enable busy polling (%s), spinning without it.\n", strerror(errno));
+
+    /* not supported by older kernels */
+    (void)setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof on);
+    (void)setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof budget);
+  } else {
+    const struct timeval timeout = { 0, READER_TIMEOUT_MS * 1000 };
+
+    checkSyscall("setsockopt(SO_RCVTIMEO)",
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout));
+  }
+}
+
+int batch_wait(struct recv_batch *b, int fd, int n, wait_mode_t mode, struct latency *latency) {
+  int num_msgs = batch_receive(b, fd, n, mode == WAIT_BUSY ? MSG_DONTWAIT : 0, latency);
+
+  if (num_msgs < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return 0;
+
+  checkSyscall("recvmmsg()", num_msgs);
+  return num_msgs;
+}
+
+void enable_gro(int fd) {
+  const int on = 1;
+
+  checkSyscall("setsockopt(UDP_GRO)",
+    setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof on));
+}
+
+void find_interface(const char *hostStr, char *ifName, size_t len) {
+  struct addrinfo hints, *ai;
+  struct ifaddrs *ifa, *i;
+  int result;
+
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family   = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if ((result = getaddrinfo(hostStr, NULL, &hints, &ai)) != 0) {
+    printf("getaddrinfo(\"%s\") failed: %s\n", hostStr, gai_strerror(result));
+    exit(EXIT_FAILURE);
+  }
+
+  const struct in_addr addr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+  freeaddrinfo(ai);
+
+  checkSyscall("getifaddrs()", getifaddrs(&ifa));
+
+  for (i = ifa; i; i = i->ifa_next) {
+    if (!i->ifa_addr || i->ifa_addr->sa_family != AF_INET)
+      continue;
+
+    if (((struct sockaddr_in *)i->ifa_addr)->sin_addr.s_addr == addr.s_addr) {
+      snprintf(ifName, len, "%s", i->ifa_name);
+      freeifaddrs(ifa);
+      return;
+    }
+  }
+
+  printf("ERROR: No interface found carrying the address of %s.\n", hostStr);
+  exit(EXIT_FAILURE);
+}
+
+int interface_node(const char *ifName) {
+  char path[256];
+  int node = -1;
+
+  snprintf(path, sizeof path, "/sys/class/net/%s/device/numa_node", ifName);
+
+  /* virtual interfaces have no device */
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return -1;
+
+  if (fscanf(f, "%d", &node) != 1)
+    node = -1;
+
+  fclose(f);
+
+  return node;
+}
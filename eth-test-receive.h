@@ -0,0 +1,269 @@
+#ifndef __ETH_TEST_RECEIVE__
+#define __ETH_TEST_RECEIVE__
+
+#include <sys/socket.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+#include "perf-counters.h"
+#include "seq-window.h"
+#include "spsc-ring.h"
+
+/* Source of the arrival timestamps of packets. */
+typedef enum { TS_NONE, TS_SOFTWARE, TS_HARDWARE } timestamp_t;
+
+/* How readers wait for packets: in blocking calls, or by spinning on
+ * non-blocking calls while the kernel busy-polls the NIC queue. */
+typedef enum { WAIT_BLOCK, WAIT_BUSY } wait_mode_t;
+
+/* Time a blocking read waits before checking whether its port is done, in ms. */
+#define READER_TIMEOUT_MS 100
+
+/* Time the kernel busy-polls the NIC queue per read, with WAIT_BUSY, in us. */
+#define BUSY_POLL_USECS   50
+
+/* Number of packets the kernel processes per busy poll, with WAIT_BUSY. */
+#define BUSY_POLL_BUDGET  64
+
+/* Size of the control data buffer of each received message. */
+#define CONTROL_SIZE 256
+
+/* Maximum size of a datagram coalesced by UDP GRO. */
+#define GRO_MSGSIZE  65536
+
+/* Maximum number of packets in one batch of received messages. */
+#define MAX_BATCH_PACKETS (MSG_BATCHSIZE * (GRO_MSGSIZE / MAX_MSGSIZE))
+
+/* Latency statistics of one port, in ns. */
+struct latency {
+  struct histogram one_way;      /* arrival - send time */
+  struct histogram kernel_delay; /* reception in user space - arrival in the kernel */
+  struct histogram jitter;       /* change in one-way latency between consecutive packets (RFC 3550) */
+  size_t nr_hardware;            /* number of packets with a hardware timestamp */
+  int64_t software_offset;       /* from CLOCK_REALTIME of software timestamps to receive_clock, in ns */
+
+  size_t  prev_packet_nr;
+  int64_t prev_transit;
+};
+
+/* Clock the sender stamped the packets with (see eth-test-send -c). Hardware
+ * timestamps are assumed to be on this clock already. */
+extern clockid_t receive_clock;
+
+/* Number of buffers of a recorder: one being filled, one being written, and one spare. */
+#define RECORD_BUFFERS 3
+
+/* Statistics of recording one port to disk. */
+struct record_stats {
+  size_t nr_bytes;         /* written to disk */
+  double write_seconds;    /* spent writing */
+  double seconds;          /* from the first to the last write */
+  size_t peak_buffers;     /* maximum number of buffers in use (filling, full or being written) */
+  size_t dropped_msgs;     /* datagrams dropped because all buffers were full */
+  size_t dropped_bytes;
+  int direct;              /* whether O_DIRECT was used */
+};
+
+/* Records received datagrams to a file, through buffers written by a separate thread. */
+struct recorder {
+  int fd;
+  size_t buffer_size;
+  struct record_buffer {
+    char *data;
+    size_t used;
+  } buffers[RECORD_BUFFERS];
+
+  struct record_buffer *current;  /* being filled, or NULL if all buffers are full */
+  struct spsc_ring full;          /* filled, waiting for the writer */
+  struct spsc_ring free;          /* written, waiting to be filled */
+
+  pthread_t writer;
+  int stop;
+  uint64_t first_write_ns, last_write_ns;
+
+  struct record_stats stats;
+};
+
+/* Start recording to `path', with buffers of `buffer_size' bytes (a multiple of DIRECT_ALIGN). */
+void recorder_open(struct recorder *r, const char *path, size_t buffer_size);
+
+/* Append a datagram. If all buffers are full, it is dropped and counted as such. */
+void recorder_add(struct recorder *r, const void *data, size_t len);
+
+/* Write the remaining data, close the file, and return the statistics. */
+struct record_stats recorder_close(struct recorder *r);
+
+/* Result of receiving one port. */
+struct report {
+  double speed_gbps;
+  double loss_perc;
+  double cpu_perc; /* CPU time spent receiving, in % of the duration */
+  size_t nr_bytes; /* received */
+  size_t corrupt;  /* packets failing payload verification, which are not counted as lost */
+  int eos;         /* the sender ended the stream before enough packets arrived */
+  int timed_out;   /* the stream stopped without an end-of-stream marker */
+  struct seq_stats seq;
+  struct latency latency;
+  struct perf_values perf; /* of the threads receiving the port */
+  struct record_stats record; /* if recording to disk */
+};
+
+/* Buffers to receive a batch of messages with recvmmsg(), and the packets
+ * they contained. With GRO, a message can contain several packets. */
+struct recv_batch {
+  size_t msg_size;
+  timestamp_t timestamps;
+  int verify;                     /* check the CRC32C of every packet */
+
+  char *buffer;                   /* MSG_BATCHSIZE buffers of msg_size bytes */
+  char (*control)[CONTROL_SIZE];  /* MSG_BATCHSIZE control data buffers */
+  struct iovec iov[MSG_BATCHSIZE];
+  struct mmsghdr msgs[MSG_BATCHSIZE];
+
+  /* packets received by the last batch_receive() */
+  int nr_packets;
+  int nr_corrupt;                 /* failed verification, and are not in packet_nrs */
+  int eos;                        /* an end-of-stream marker arrived */
+  size_t eos_last;                /* last packet number sent, according to the marker */
+  size_t nr_bytes;
+  size_t packet_nrs[MAX_BATCH_PACKETS];
+};
+
+/* Allocate buffers for receiving with the given timestamps, GRO if `gro' is set,
+ * and payload verification if `verify' is set. */
+struct recv_batch *batch_alloc(int gro, timestamp_t timestamps, int verify);
+
+void batch_free(struct recv_batch *b);
+
+/* Receive up to `n' messages from fd (see recvmmsg()), and split them into packets.
+ * If `latency' is not NULL, the latencies of the packets are added to it.
+ *
+ * Returns the result of recvmmsg().
+ */
+int batch_receive(struct recv_batch *b, int fd, int n, int flags, struct latency *latency);
+
+/* Prepare fd for reading in `mode'. */
+void set_wait_mode(int fd, wait_mode_t mode);
+
+/* Receive up to `n' messages from fd as batch_receive(), waiting in `mode'.
+ * Returns 0 if nothing arrived within READER_TIMEOUT_MS (or, when busy polling,
+ * right away), and bails on errors. */
+int batch_wait(struct recv_batch *b, int fd, int n, wait_mode_t mode, struct latency *latency);
+
+/* Let the kernel coalesce packets arriving on fd (UDP_GRO). */
+void enable_gro(int fd);
+
+/* Accounting of one port, shared by all threads receiving it. */
+struct port_state {
+  pthread_spinlock_t lock;
+  struct seq_window window;
+  int started;
+  int done;
+  int eos, timed_out;          /* how the port ended, if not by receiving enough packets */
+  size_t nr_bytes, nr_msgs;
+  size_t nr_corrupt;
+  struct timespec first, last; /* arrival of the first and last packet */
+  struct series *series;       /* progress, or NULL */
+};
+
+void port_init(struct port_state *p);
+
+/* Account for `n' received packets with numbers packet_nrs[], and `nr_corrupt'
+ * packets that failed verification, totalling nr_bytes, that arrived at `now'.
+ * The first packet of a port only starts the measurement. Packets beyond
+ * `target' received messages are ignored.
+ *
+ * Returns 1 if this call completed the port, 0 otherwise.
+ */
+int port_add(struct port_state *p, const size_t *packet_nrs, int n, int nr_corrupt, size_t nr_bytes, const struct timespec *now, size_t target);
+
+/* End the port, because the sender sent `last_packet_nr' as its last packet.
+ * Returns 1 if this call ended the port, 0 otherwise. */
+int port_end(struct port_state *p, size_t last_packet_nr);
+
+/* End the port if nothing arrived for idle_ns until `now': since its last packet if
+ * it started, or since the first packet on any port if it did not.
+ * Returns 1 if this call ended the port, 0 otherwise. */
+int port_check_idle(struct port_state *p, const struct timespec *now, uint64_t idle_ns);
+
+/* Return the report of port number `port', and release its resources. */
+struct report port_report(struct port_state *p, unsigned short port);
+
+/* Print the summary of nr_reports ports, including their recording statistics if
+ * `recording' is set and their corrupt packets if `verify' is set, and return the totals. */
+struct report receive_summary(const struct report *reports, int nr_reports, int recording, int verify);
+
+/* Do not count the corrupt packets of `r' as lost: they did arrive. */
+void discount_corrupt(struct report *r);
+
+/* Count all `expected' packets of `r' as lost, for a port whose stream never started. */
+void report_all_lost(struct report *r, size_t expected);
+
+/* Note that a port received its first packet at `now', on the clock of the backend. */
+void mark_first_arrival(const struct timespec *now);
+
+/* Return whether idle_ns passed between the first packet on any port and `now', so a
+ * port that is still waiting for its first packet can give up. */
+int never_started(const struct timespec *now, uint64_t idle_ns);
+
+/* Let the kernel (or NIC) timestamp the packets arriving on fd, which receives on hostStr. */
+void enable_timestamps(int fd, const char *hostStr, timestamp_t mode);
+
+void latency_init(struct latency *l);
+
+/* Account for the latency of packet `packet_nr' sent at `send_time', received with
+ * header `hdr' at time `now' (CLOCK_REALTIME). */
+void latency_add(struct latency *l, const struct msghdr *hdr, size_t packet_nr, uint64_t send_time, const struct timespec *now);
+
+/* Add the statistics of `l' to `total'. */
+void latency_merge(struct latency *total, const struct latency *l);
+
+void latency_print(const char *prefix, const struct latency *l);
+
+/* Return the name of the interface carrying the IPv4 address of hostStr. */
+void find_interface(const char *hostStr, char *ifName, size_t len);
+
+/* Return the NUMA node of the NIC behind interface ifName, or -1 if unknown. */
+int interface_node(const char *ifName);
+
+/* Maximum number of CPUs to pin readers to. */
+#define MAX_CPUS 1024
+
+/* Receive on hostStr:port through a UDP socket, waiting in `wait'. The port ends when
+ * enough packets arrived, at an end-of-stream marker, or when nothing arrived for idleMs
+ * after the first packet. If series is not NULL, the progress is published in it. If
+ * recordPrefix is not NULL, the received datagrams are recorded to the file
+ * <recordPrefix>.<port>, through buffers of recordBufferSize bytes. */
+struct report receive_data(const char *hostStr, unsigned short port, timestamp_t timestamps, int gro, int verify, wait_mode_t wait, int idleMs, struct series *series, const char *recordPrefix, size_t recordBufferSize);
+
+/* Receive part of a port through a socket sharing it with other readers, while
+ * running on `cpu' and waiting in `wait'. If `steer' is set, ask the kernel to
+ * deliver the packets processed on `cpu' to this reader. The port ends as with
+ * receive_data().
+ *
+ * Returns the number of messages read by this reader, adds their latencies
+ * to `latency', the CPU time spent to `cpu_seconds', and the hardware counters
+ * to `perf'.
+ */
+size_t read_port(const char *hostStr, unsigned short port, struct port_state *p, int cpu, int steer, timestamp_t timestamps, int gro, int verify, wait_mode_t wait, int idleMs, struct latency *latency, double *cpu_seconds, struct perf_values *perf);
+
+/* Accept a control connection from eth-test-send -C on hostStr:controlPort, and run the
+ * trials it asks for on ports starting at firstPort, until it ends the series. Every trial
+ * receives through a socket and thread per port, waiting in `wait', and ends when all
+ * packets, an end-of-stream marker, or nothing arrived for idleMs.
+ */
+void serve_trials(const char *hostStr, unsigned short firstPort, unsigned short controlPort, wait_mode_t wait, int idleMs);
+
+/* Receive on ports [firstPort, firstPort + nrPorts) of hostStr through a memory-mapped
+ * TPACKET_V3 ring, using nrThreads threads in a fanout group, and fill reports[port].
+ * If series is not NULL, the progress of each port is published in series[port].
+ * If verify is set, the payload of every packet is verified. Ports end as with
+ * receive_data(), but the ring always waits by blocking.
+ *
+ * If ifName is NULL, the interface carrying hostStr is used.
+ */
+void receive_ring(const char *hostStr, const char *ifName, unsigned short firstPort, int nrPorts, int nrThreads, int verify, int idleMs, struct report *reports, struct series *series);
+
+#endif
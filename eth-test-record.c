@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "disk-io.h"
+#include "eth-test-receive.h"
+
+/* Time the writer sleeps when there is nothing to write, in ns. */
+#define WRITER_POLL_NS 100000
+
+/* Write a buffer at the end of the file. With O_DIRECT, a partial last buffer is
+ * padded to DIRECT_ALIGN, and the file is truncated afterwards. */
+static void write_buffer(struct recorder *r, struct record_buffer *b) {
+  const size_t size = r->stats.direct ? (b->used + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN : b->used;
+  const uint64_t begin = now_ns();
+  size_t done = 0;
+
+  if (r->first_write_ns == 0)
+    r->first_write_ns = begin;
+
+  while (done < size) {
+    const ssize_t res = pwrite(r->fd, b->data + done, size - done, r->stats.nr_bytes + done);
+
+    if (res < 0 && errno == EINTR)
+      continue;
+
+    checkSyscall("pwrite()", res);
+    done += res;
+  }
+
+  r->last_write_ns = now_ns();
+  r->stats.write_seconds += (r->last_write_ns - begin) / 1e9;
+  r->stats.nr_bytes += b->used;
+  b->used = 0;
+}
+
+static void *writer_thread(void *arg) {
+  struct recorder *r = arg;
+  struct record_buffer *b;
+
+  for (;;) {
+    if ((b = spsc_pop(&r->full))) {
+      write_buffer(r, b);
+      spsc_push(&r->free, b);
+    } else if (__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+      /* write what was queued before we were stopped */
+      while ((b = spsc_pop(&r->full)))
+        write_buffer(r, b);
+      break;
+    } else {
+      const struct timespec ts = { 0, WRITER_POLL_NS };
+      nanosleep(&ts, NULL);
+    }
+  }
+
+  return NULL;
+}
+
+void recorder_open(struct recorder *r, const char *path, size_t buffer_size) {
+  int i;
+
+  memset(r, 0, sizeof *r);
+  r->buffer_size = buffer_size;
+  r->fd = open_direct(path, O_CREAT | O_TRUNC | O_WRONLY, &r->stats.direct);
+
+  if (!r->stats.direct)
+    printf("%s does not support O_DIRECT, recording through the page cache.\n", path);
+
+  spsc_init(&r->full, RECORD_BUFFERS + 1);  /* power of two */
+  spsc_init(&r->free, RECORD_BUFFERS + 1);
+
+  for (i = 0; i < RECORD_BUFFERS; i++) {
+    r->buffers[i].data = alloc_direct(buffer_size);
+    memset(r->buffers[i].data, 0, buffer_size); /* fault in the pages now */
+    spsc_push(&r->free, &r->buffers[i]);
+  }
+
+  r->current = spsc_pop(&r->free);
+
+  if (pthread_create(&r->writer, NULL, writer_thread, r) != 0) {
+    printf("ERROR: Could not start the writer thread.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void recorder_add(struct recorder *r, const void *data, size_t len) {
+  const char *src = data;
+
+  /* buffers are filled completely, keeping the writes aligned for O_DIRECT */
+  const size_t space = (r->current ? r->buffer_size - r->current->used : 0) + spsc_count(&r->free) * r->buffer_size;
+
+  if (len > space) {
+    /* the writer cannot keep up */
+    r->stats.dropped_msgs++;
+    r->stats.dropped_bytes += len;
+    return;
+  }
+
+  while (len > 0) {
+    if (!r->current) {
+      r->current = spsc_pop(&r->free);
+
+      /* buffers being filled, waiting for the writer, or being written */
+      const size_t in_use = RECORD_BUFFERS - spsc_count(&r->free);
+      if (in_use > r->stats.peak_buffers)
+        r->stats.peak_buffers = in_use;
+    }
+
+    const size_t n = len < r->buffer_size - r->current->used ? len : r->buffer_size - r->current->used;
+
+    memcpy(r->current->data + r->current->used, src, n);
+    r->current->used += n;
+    src += n;
+    len -= n;
+
+    /* hand over full buffers to the writer */
+    if (r->current->used == r->buffer_size) {
+      spsc_push(&r->full, r->current);
+      r->current = NULL;
+    }
+  }
+}
+
+struct record_stats recorder_close(struct recorder *r) {
+  int i;
+
+  if (r->current && r->current->used > 0)
+    spsc_push(&r->full, r->current);
+
+  __atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(r->writer, NULL);
+
+  /* remove the padding of the last buffer */
+  if (r->stats.direct)
+    checkSyscall("ftruncate()", ftruncate(r->fd, r->stats.nr_bytes));
+
+  checkSyscall("fdatasync()", fdatasync(r->fd));
+  r->last_write_ns = now_ns();
+  close(r->fd);
+
+  r->stats.seconds = r->first_write_ns ? (r->last_write_ns - r->first_write_ns) / 1e9 : 0.0;
+
+  for (i = 0; i < RECORD_BUFFERS; i++)
+    free(r->buffers[i].data);
+
+  spsc_destroy(&r->full);
+  spsc_destroy(&r->free);
+
+  return r->stats;
+}
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+#include "eth-test-payload.h"
+#include "eth-test-receive.h"
+
+/* Geometry of the ring of each thread: 32 blocks of 4 MByte. */
+#define RING_BLOCK_SIZE    (4 << 20)
+#define RING_BLOCK_NR      32
+#define RING_FRAME_SIZE    2048
+
+/* Time after which the kernel hands us a partially filled block, in ms. */
+#define RING_BLOCK_TIMEOUT 10
+
+struct ring {
+  int fd;
+  uint8_t *map;
+  struct tpacket_req3 req;
+};
+
+static void open_ring(struct ring *r, int ifIndex, int fanoutGroup) {
+  const int version = TPACKET_V3;
+  const int on = 1;
+  const int fanout = fanoutGroup | (PACKET_FANOUT_HASH << 16);
+
+  checkSyscall("socket(AF_PACKET)",
+    r->fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP)));
+
+  checkSyscall("setsockopt(PACKET_VERSION)",
+    setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof version));
+
+  /* don't see our own transmissions when testing over loopback (Linux 4.20+) */
+  (void)setsockopt(r->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &on, sizeof on);
+
+  memset(&r->req, 0, sizeof r->req);
+  r->req.tp_block_size     = RING_BLOCK_SIZE;
+  r->req.tp_block_nr       = RING_BLOCK_NR;
+  r->req.tp_frame_size     = RING_FRAME_SIZE;
+  r->req.tp_frame_nr       = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_NR;
+  r->req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT;
+
+  checkSyscall("setsockopt(PACKET_RX_RING)",
+    setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &r->req, sizeof r->req));
+
+  r->map = mmap(NULL, (size_t)RING_BLOCK_SIZE * RING_BLOCK_NR, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, 0);
+  if (r->map == MAP_FAILED)
+    checkSyscall("mmap()", -1);
+
+  struct sockaddr_ll sll;
+  memset(&sll, 0, sizeof sll);
+  sll.sll_family   = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_IP);
+  sll.sll_ifindex  = ifIndex;
+
+  checkSyscall("bind(AF_PACKET)",
+    bind(r->fd, (struct sockaddr *)&sll, sizeof sll));
+
+  checkSyscall("setsockopt(PACKET_FANOUT)",
+    setsockopt(r->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof fanout));
+}
+
+static void close_ring(struct ring *r) {
+  munmap(r->map, (size_t)RING_BLOCK_SIZE * RING_BLOCK_NR);
+  close(r->fd);
+}
+
+/* Account for one frame. Returns 1 if this frame completed its port. */
+static int process_frame(const struct tpacket3_hdr *ppd, struct port_state *ports, unsigned short firstPort, int nrPorts, int verify, size_t target) {
+  const struct sockaddr_ll *sll = (const void *)((const uint8_t *)ppd + TPACKET_ALIGN(sizeof *ppd));
+  const uint8_t *data = (const uint8_t *)ppd + ppd->tp_net;
+  const size_t len = ppd->tp_snaplen;
+
+  if (sll->sll_pkttype == PACKET_OUTGOING)
+    return 0;
+
+  /* only consider unfragmented UDP */
+  const struct iphdr *ip = (const struct iphdr *)data;
+  if (len < sizeof *ip || ip->protocol != IPPROTO_UDP || (ip->frag_off & htons(IP_MF | IP_OFFMASK)))
+    return 0;
+
+  const size_t ihl = ip->ihl * 4;
+  const struct udphdr *udp = (const struct udphdr *)(data + ihl);
+  if (len < ihl + sizeof *udp + sizeof(size_t))
+    return 0;
+
+  const int port = ntohs(udp->dest) - firstPort;
+  if (port < 0 || port >= nrPorts)
+    return 0;
+
+  const size_t udp_len = ntohs(udp->len) - sizeof *udp;
+
+  /* use the kernel timestamp of the frame */
+  const struct timespec ts = { ppd->tp_sec, ppd->tp_nsec };
+
+  size_t packet_nr;
+  memcpy(&packet_nr, udp + 1, sizeof packet_nr);
+
+  if (packet_nr == EOS_PACKET_NR && len >= ihl + sizeof *udp + offsetof(struct message, payload)) {
+    uint64_t last_packet_nr;
+
+    memcpy(&last_packet_nr, (const uint8_t *)(udp + 1) + offsetof(struct message, send_time), sizeof last_packet_nr);
+    return port_end(&ports[port], last_packet_nr);
+  }
+
+  /* frames truncated by the ring cannot be verified */
+  if (verify && len >= ihl + sizeof *udp + udp_len && !payload_verify(udp + 1, udp_len))
+    return port_add(&ports[port], NULL, 0, 1, udp_len, &ts, target);
+
+  return port_add(&ports[port], &packet_nr, 1, 0, udp_len, &ts, target);
+}
+
+void receive_ring(const char *hostStr, const char *ifName, unsigned short firstPort, int nrPorts, int nrThreads, int verify, int idleMs, struct report *reports, struct series *series) {
+  const size_t target = (size_t)NR_BATCHES * MSG_BATCHSIZE;
+  const int fanoutGroup = getpid() & 0xffff;
+  struct port_state *ports;
+  char ifNameBuf[IF_NAMESIZE];
+  int udp_fds[nrPorts];
+  int i;
+
+  if (!ifName) {
+    find_interface(hostStr, ifNameBuf, sizeof ifNameBuf);
+    ifName = ifNameBuf;
+  }
+
+  const int ifIndex = if_nametoindex(ifName);
+  checkSyscall("if_nametoindex()", ifIndex ? 0 : -1);
+
+  printf("Capturing on %s with %d threads.\n", ifName, nrThreads);
+
+  ports = malloc(nrPorts * sizeof *ports);
+  for (i = 0; i < nrPorts; i++) {
+    port_init(&ports[i]);
+    ports[i].series = series ? &series[i] : NULL;
+  }
+
+  /* keep the ports open, so the sender doesn't get ICMP port unreachable
+   * errors. We never read from these sockets, so keep their buffers minimal. */
+  for (i = 0; i < nrPorts; i++) {
+    const int zero = 0;
+
+    udp_fds[i] = create_udp_socket(hostStr, firstPort + i, 1);
+    (void)setsockopt(udp_fds[i], SOL_SOCKET, SO_RCVBUF, &zero, sizeof zero);
+  }
+
+  int nr_done = 0;
+  unsigned total_drops = 0, total_freezes = 0;
+
+#pragma omp parallel num_threads(nrThreads)
+  {
+    struct ring r;
+    unsigned block = 0;
+
+    open_ring(&r, ifIndex, fanoutGroup);
+
+#pragma omp barrier
+#pragma omp single
+    printf("Waiting for UDP packets...\n");
+
+    while (__atomic_load_n(&nr_done, __ATOMIC_RELAXED) < nrPorts) {
+      struct tpacket_block_desc *bd = (struct tpacket_block_desc *)(r.map + (size_t)block * RING_BLOCK_SIZE);
+
+      if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+        struct pollfd pfd = { r.fd, POLLIN | POLLERR, 0 };
+
+        struct timespec now;
+        int port;
+
+        poll(&pfd, 1, 100);
+
+        /* give up on ports that stopped without an end-of-stream marker,
+         * on the clock of the frame timestamps */
+        clock_gettime(CLOCK_REALTIME, &now);
+        for (port = 0; port < nrPorts; port++) {
+          if (port_check_idle(&ports[port], &now, (uint64_t)idleMs * 1000000))
+            __atomic_add_fetch(&nr_done, 1, __ATOMIC_RELAXED);
+        }
+        continue;
+      }
+
+      /* walk all frames in this block */
+      const struct tpacket3_hdr *ppd = (const struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+      unsigned f;
+
+      for (f = 0; f < bd->hdr.bh1.num_pkts; f++) {
+        if (process_frame(ppd, ports, firstPort, nrPorts, verify, target))
+          __atomic_add_fetch(&nr_done, 1, __ATOMIC_RELAXED);
+
+        ppd = (const struct tpacket3_hdr *)((const uint8_t *)ppd + ppd->tp_next_offset);
+      }
+
+      /* hand the block back to the kernel */
+      __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+      block = (block + 1) % RING_BLOCK_NR;
+    }
+
+    /* drops due to a full ring */
+    struct tpacket_stats_v3 stats;
+    socklen_t stats_len = sizeof stats;
+
+    if (getsockopt(r.fd, SOL_PACKET, PACKET_STATISTICS, &stats, &stats_len) == 0) {
+      __atomic_add_fetch(&total_drops, stats.tp_drops, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&total_freezes, stats.tp_freeze_q_cnt, __ATOMIC_RELAXED);
+    }
+
+    close_ring(&r);
+  }
+
+  /* report per port */
+  for (i = 0; i < nrPorts; i++) {
+    reports[i] = port_report(&ports[i], firstPort + i);
+  }
+
+  printf("Ring drops:   %u packets (%u queue freezes)\n", total_drops, total_freezes);
+
+  /* Teardown */
+  for (i = 0; i < nrPorts; i++) {
+    close(udp_fds[i]);
+  }
+
+  free(ports);
+}
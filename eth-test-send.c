@@ -1,66 +1,16 @@
 #define _GNU_SOURCE
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <omp.h>
 
 #include "common.h"
 #include "eth-test-params.h"
-
-void send_data(const char *hostStr, unsigned short port) {
-  int fd = create_udp_socket(hostStr, port, 0);
-  int i;
-
-  struct message buffer[MSG_BATCHSIZE];
-
-  /* setup sendmsg/recvmmsg structures */
-  struct iovec iov[MSG_BATCHSIZE];
-  struct mmsghdr msgs[MSG_BATCHSIZE];
-
-  for( i = 0; i < MSG_BATCHSIZE; i++ ) {
-    iov[i].iov_base = &buffer[i];
-    iov[i].iov_len  = MAX_MSGSIZE;
-    msgs[i].msg_hdr.msg_name    = NULL;
-    msgs[i].msg_hdr.msg_namelen = 0;
-    msgs[i].msg_hdr.msg_iov     = &iov[i];
-    msgs[i].msg_hdr.msg_iovlen  = 1;
-    msgs[i].msg_hdr.msg_control = NULL;
-    msgs[i].msg_hdr.msg_controllen = 0;
-    msgs[i].msg_hdr.msg_flags   = 0;
-  }
-
-#pragma omp barrier
-  printf("Sending UDP packets...\n");
-  size_t packet_nr = 0;
-  struct timeval first_packet_timestamp;
-  gettimeofday(&first_packet_timestamp, 0);
-
-  size_t late = 0;
-
-  while( packet_nr < NR_BATCHES * MSG_BATCHSIZE * 2 ) { /* overshoot to allow for some loss */
-    packet_nr ++;
-
-    /* wait for deadline of next packet according to desired data rate */
-    struct timeval next_packet_at = first_packet_timestamp;
-    timeval_add(&next_packet_at, 1000000 * packet_nr * MAX_MSGSIZE / (SPEED_BITS_PER_SEC / 8));
-    late += wait_until(next_packet_at);
-
-    /* construct and send one packet */
-    buffer[0].packet_nr = packet_nr;
-    (void)sendmsg(fd, &msgs[0].msg_hdr, 0);
-  }
-
-  /* report */
-  printf("Sent %ld packets, %.2f%% late.\n", packet_nr, 100.0*late/packet_nr);
-
-  /* Teardown */
-  close(fd);
-}
+#include "eth-test-control.h"
+#include "eth-test-payload.h"
+#include "eth-test-send.h"
 
 void usage(const char *progname) {
   printf("Usage: %s -H hostname [options]\n", progname);
@@ -68,6 +18,21 @@ void usage(const char *progname) {
   printf("\n");
   printf("  -H      Host name (or IP address) to send to.\n");
   printf("  -P      First port number to receive on [5000].\n");
+  printf("  -s      Speed per port, in Mbit/s [%.0f].\n", SPEED_BITS_PER_SEC / 1e6);
+  printf("  -M      Send engine: single (one sendmsg() per packet), bucket (paced sendmmsg())\n");
+  printf("          or wheel (all ports from a few threads, scheduled on a timing wheel) [bucket].\n");
+  printf("  -w      Number of threads sending to the ports, each pinned to a CPU, for -M wheel [1, max %d].\n", MAX_WHEELS);
+  printf("  -b      Maximum number of packets per sendmmsg() call [%d].\n", MSG_BATCHSIZE);
+  printf("  -f      Number of flows (source ports) per port, for -M bucket [1].\n");
+  printf("  -c      Clock to timestamp packets with: realtime or tai [realtime].\n");
+  printf("  -V      Fill the payloads with a pattern and a CRC32C, for the receiver to verify.\n");
+  printf("  -G      Send up to this many packets per super-packet (UDP GSO), for -M bucket [1, max %d].\n", (int)MAX_GSO_SEGS);
+  printf("  -C      Search the highest lossless rate against eth-test-receive -C, on this TCP port [off, typically %d].\n", CONTROL_PORT);
+  printf("  -S      Packet sizes to search, in bytes, for -C [1472,4096,%d].\n", MAX_MSGSIZE);
+  printf("  -n      Port counts to search, for -C [1,4,%d].\n", NR_PORTS);
+  printf("  -L      Highest total speed to search, in Mbit/s, for -C [10000].\n");
+  printf("  -r      Resolution of the search, in Mbit/s, for -C [100].\n");
+  printf("  -D      Duration of each trial, in ms, for -C [1000].\n");
   printf("  -h      Show this help.\n");
 }
 
@@ -78,11 +43,36 @@ int main(int argc, char **argv) {
   int firstPort = 5000;
   /* Number of ports to listen on. */
   const int nrPorts = NR_PORTS;
+  /* Engine to send with. */
+  send_engine_t engine = BUCKET;
+  /* Speed per port, in bits/s. */
+  double speedBps = SPEED_BITS_PER_SEC;
+  /* Number of threads for the wheel engine. */
+  int nrWheels = 1;
+  /* Maximum number of packets per send call. */
+  int maxBatch = MSG_BATCHSIZE;
+  /* Number of flows per port. */
+  int nrFlows = 1;
+  /* Number of packets per GSO super-packet. */
+  int gsoSegs = 1;
+  /* Fill the payloads with verifiable data. */
+  int verify = 0;
+  /* Search the capacity through a control connection on this port, if set. */
+  struct sweep_config sweepConfig = {
+    .control_port   = 0,
+    .msg_sizes      = { 1472, 4096, MAX_MSGSIZE },
+    .nr_msg_sizes   = 3,
+    .port_counts    = { 1, 4, NR_PORTS },
+    .nr_port_counts = 3,
+    .max_bps        = 10e9,
+    .resolution_bps = 100e6,
+    .trial_ms       = 1000,
+  };
 
   int i, opt;
 
   /* parse command-line options */
-  while ((opt = getopt(argc, argv, "H:P:h")) != -1) {
+  while ((opt = getopt(argc, argv, "H:P:s:M:w:b:f:c:G:VC:S:n:L:r:D:h")) != -1) {
     switch (opt) {
     case 'H':
       hostStr = strdup(optarg);
@@ -92,6 +82,126 @@ int main(int argc, char **argv) {
       firstPort = atoi(optarg);
       break;
 
+    case 's':
+      speedBps = atof(optarg) * 1e6;
+      if (speedBps <= 0.0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'M':
+      if (!strcmp(optarg, "single")) {
+        engine = SINGLE;
+      } else if (!strcmp(optarg, "bucket")) {
+        engine = BUCKET;
+      } else if (!strcmp(optarg, "wheel")) {
+        engine = WHEEL;
+      } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'w':
+      nrWheels = atoi(optarg);
+      if (nrWheels < 1 || nrWheels > MAX_WHEELS) {
+        printf("Number of wheel threads must be between 1 and %d.\n", MAX_WHEELS);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'b':
+      maxBatch = atoi(optarg);
+      if (maxBatch < 1 || maxBatch > MSG_BATCHSIZE) {
+        printf("Batch size must be between 1 and %d.\n", MSG_BATCHSIZE);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'c':
+      if (!strcmp(optarg, "realtime")) {
+        send_clock = CLOCK_REALTIME;
+      } else if (!strcmp(optarg, "tai")) {
+        send_clock = CLOCK_TAI;
+      } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'G':
+      gsoSegs = atoi(optarg);
+      if (gsoSegs < 1 || gsoSegs > MAX_GSO_SEGS) {
+        printf("Number of GSO segments must be between 1 and %d.\n", (int)MAX_GSO_SEGS);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'V':
+      verify = 1;
+      break;
+
+    case 'f':
+      nrFlows = atoi(optarg);
+      if (nrFlows < 1 || nrFlows > MAX_FLOWS) {
+        printf("Number of flows must be between 1 and %d.\n", MAX_FLOWS);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'C':
+      sweepConfig.control_port = atoi(optarg);
+      break;
+
+    case 'S':
+      sweepConfig.nr_msg_sizes = parse_sweep_list(optarg, sweepConfig.msg_sizes, MAX_SWEEP_POINTS);
+      for ( i = 0; i < sweepConfig.nr_msg_sizes; i++ ) {
+        if (sweepConfig.msg_sizes[i] < MIN_MSGSIZE || sweepConfig.msg_sizes[i] > MAX_MSGSIZE)
+          sweepConfig.nr_msg_sizes = -1;
+      }
+      if (sweepConfig.nr_msg_sizes < 0) {
+        printf("Packet sizes must be a list of up to %d sizes between %d and %d bytes.\n", MAX_SWEEP_POINTS, MIN_MSGSIZE, MAX_MSGSIZE);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'n':
+      sweepConfig.nr_port_counts = parse_sweep_list(optarg, sweepConfig.port_counts, MAX_SWEEP_POINTS);
+      for ( i = 0; i < sweepConfig.nr_port_counts; i++ ) {
+        if (sweepConfig.port_counts[i] > MAX_TRIAL_PORTS)
+          sweepConfig.nr_port_counts = -1;
+      }
+      if (sweepConfig.nr_port_counts < 0) {
+        printf("Port counts must be a list of up to %d counts between 1 and %d.\n", MAX_SWEEP_POINTS, MAX_TRIAL_PORTS);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'L':
+      sweepConfig.max_bps = atof(optarg) * 1e6;
+      if (sweepConfig.max_bps <= 0.0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'r':
+      sweepConfig.resolution_bps = atof(optarg) * 1e6;
+      if (sweepConfig.resolution_bps <= 0.0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'D':
+      sweepConfig.trial_ms = atoi(optarg);
+      if (sweepConfig.trial_ms < 1) {
+        printf("Trial duration must be at least 1 ms.\n");
+        return EXIT_FAILURE;
+      }
+      break;
+
     case 'h':
       usage(argv[0]);
       return EXIT_SUCCESS;
@@ -112,20 +222,67 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
 
+  /* search the capacity instead of sending once */
+  if (sweepConfig.control_port) {
+    sweepConfig.host       = hostStr;
+    sweepConfig.first_port = firstPort;
+    sweepConfig.max_batch  = maxBatch;
+    sweepConfig.nr_wheels  = nrWheels;
+    sweepConfig.verify     = verify;
+
+    printf("Target host: %s\n", hostStr);
+    printf("First port:  %d\n", firstPort);
+    printf("Engine:      wheel\n");
+    printf("Threads:     %d\n", nrWheels);
+
+    sweep(&sweepConfig);
+
+    printf("Done.\n");
+    return EXIT_SUCCESS;
+  }
+
   /* print configuration */
   printf("Target host: %s\n", hostStr);
   printf("First port:  %d\n", firstPort);
   printf("Port count:  %d\n", nrPorts);
-
-  /* initialise */
-  omp_set_num_threads(nrPorts);
+  printf("Speed:       %.2f Gbit/s per port\n", speedBps / 1e9);
+  printf("Engine:      %s\n", engine == SINGLE ? "single" : engine == BUCKET ? "bucket" : "wheel");
+  if (engine == WHEEL)
+    printf("Threads:     %d\n", nrWheels);
+  if (engine == BUCKET) {
+    printf("Max batch:   %d\n", maxBatch);
+    printf("Flows/port:  %d\n", nrFlows);
+    printf("GSO:         %d packets/super-packet\n", gsoSegs);
+  }
+  if (verify)
+    printf("Payload:     pattern + CRC32C (%s)\n", crc32c_name());
 
   /* send data on all ports in parallel */
+  struct send_report reports[nrPorts];
+
+  if (engine == WHEEL) {
+    printf("Sending UDP packets from %d threads...\n", nrWheels);
+    omp_set_num_threads(nrWheels);
+
+#pragma omp parallel num_threads(nrWheels)
+    wheel_thread(hostStr, firstPort, nrPorts, omp_get_thread_num(), nrWheels, speedBps, MAX_MSGSIZE, NR_PACKETS_SENT, maxBatch, verify, reports);
+  } else {
+    omp_set_num_threads(nrPorts);
+
 #pragma omp parallel for num_threads(nrPorts)
-  for ( i = 0; i < nrPorts; i++ ) {
-    send_data(hostStr, firstPort + i);
+    for ( i = 0; i < nrPorts; i++ ) {
+      reports[i] = engine == SINGLE
+                 ? send_single(hostStr, firstPort + i, speedBps, verify)
+                 : send_bucket(hostStr, firstPort + i, speedBps, maxBatch, nrFlows, gsoSegs, verify);
+    }
   }
 
+  /* calculate and show summary */
+  if (engine == WHEEL)
+    wheel_print(reports, firstPort, nrPorts, speedBps);
+
+  send_summary(reports, nrPorts, speedBps);
+
   printf("Done.\n");
 
   return EXIT_SUCCESS;
@@ -0,0 +1,105 @@
+#ifndef __ETH_TEST_SEND__
+#define __ETH_TEST_SEND__
+
+#include <time.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+
+/* Number of batch-size histogram buckets: 1, 2-3, 4-7, ..., >= 2^(N-1) */
+#define BATCH_BUCKETS 8
+
+/* Result of sending to one port. */
+struct send_report {
+  double speed_gbps;
+  double late_perc;
+  size_t nr_packets;     /* accepted by the kernel */
+  size_t send_errors;    /* packets the kernel did not accept */
+  int last_errno;        /* of the last failed send */
+  size_t nr_calls;       /* number of send syscalls */
+  size_t max_batch;      /* largest number of packets sent in one call */
+  size_t batch_hist[BATCH_BUCKETS];
+  struct histogram lateness; /* time woken up after each deadline, in ns */
+};
+
+/* Maximum number of packets in a GSO super-packet, which must fit in one UDP datagram. */
+#define MAX_GSO_SEGS (65507 / MAX_MSGSIZE)
+
+/* Number of packets sent per port: twice what the receiver waits for, to allow for some loss. */
+#define NR_PACKETS_SENT ((size_t)NR_BATCHES * MSG_BATCHSIZE * 2)
+
+/* Maximum number of flows (source ports) per destination port. */
+#define MAX_FLOWS 64
+
+/* Granularity and size of the timing wheel of send_wheel(): 256 slots of 8 us, spanning 2 ms. */
+#define WHEEL_TICK_NS 8192
+#define WHEEL_SLOTS   256
+
+/* Maximum number of threads sending with send_wheel(). */
+#define MAX_WHEELS    NR_PORTS
+
+typedef enum { SINGLE, BUCKET, WHEEL } send_engine_t;
+
+/* Clock to timestamp the packets with [CLOCK_REALTIME]. */
+extern clockid_t send_clock;
+
+/* Send to hostStr:port at speed_bps bits/s, one packet per sendmsg(). If `verify' is set,
+ * the payloads are filled with a pattern and a CRC32C (see payload_fill()). */
+struct send_report send_single(const char *hostStr, unsigned short port, double speed_bps, int verify);
+
+/* Send to hostStr:port at speed_bps bits/s with sendmmsg(), up to max_batch packets per call,
+ * rotating over nr_flows source ports, in super-packets of gso_segs packets. */
+struct send_report send_bucket(const char *hostStr, unsigned short port, double speed_bps, size_t max_batch, int nr_flows, int gso_segs, int verify);
+
+/* Send nr_packets packets of msg_size bytes to each of hostStr:ports[0..nr_ports) at
+ * speed_bps bits/s each from the calling thread, through one unconnected socket. The
+ * next packet of every port is scheduled on a timing wheel, and all packets due in the
+ * same tick are sent in one sendmmsg() call of up to max_batch packets, interleaving
+ * the ports. If cpu >= 0, the thread is pinned to it. Fills reports[0..nr_ports).
+ */
+void send_wheel(const char *hostStr, const unsigned short *ports, int nr_ports, double speed_bps, size_t msg_size, size_t nr_packets, size_t max_batch, int cpu, int verify, struct send_report *reports);
+
+/* Send with send_wheel() as wheel `wheel' of nr_wheels, which together send to ports
+ * [firstPort, firstPort + nrPorts). Wheel w sends to every nr_wheels'th port starting at
+ * port w, pinned to the w'th CPU we may run on, and fills their reports[]. */
+void wheel_thread(const char *hostStr, unsigned short first_port, int nr_ports, int wheel, int nr_wheels, double speed_bps, size_t msg_size, size_t nr_packets, size_t max_batch, int verify, struct send_report *reports);
+
+/* Print the rate error and lateness of the nr_ports ports sent to with wheel_thread(). */
+void wheel_print(const struct send_report *reports, unsigned short first_port, int nr_ports, double speed_bps);
+
+/* Maximum number of packet sizes or port counts in a sweep. */
+#define MAX_SWEEP_POINTS 16
+
+/* A search for the highest lossless rate, run against eth-test-receive -C. */
+struct sweep_config {
+  const char *host;
+  unsigned short first_port;
+  unsigned short control_port;
+
+  long msg_sizes[MAX_SWEEP_POINTS];   /* bytes per packet to try */
+  int nr_msg_sizes;
+  long port_counts[MAX_SWEEP_POINTS]; /* numbers of ports to try */
+  int nr_port_counts;
+
+  double max_bps;        /* highest total rate to try, in bits/s */
+  double resolution_bps; /* stop searching once the bounds are this close */
+  int trial_ms;          /* duration of each trial */
+
+  size_t max_batch;      /* see send_wheel() */
+  int nr_wheels;
+  int verify;
+};
+
+/* Parse a comma-separated list of at most `max' positive numbers into values[], and return
+ * their number, or -1 if `str' is not such a list. */
+int parse_sweep_list(const char *str, long *values, int max);
+
+/* For every combination of packet size and port count, binary-search the highest total rate
+ * at which the receiver loses no packets, sending with the timing wheel. Print every trial,
+ * and the capacity curve at the end. */
+void sweep(const struct sweep_config *c);
+
+/* Print the summary of sending to nr_reports ports at desired_bps bits/s each, and return the totals. */
+struct send_report send_summary(const struct send_report *reports, int nr_reports, double desired_bps);
+
+#endif
@@ -0,0 +1,625 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/udp.h>
+#include <time.h>
+#include <omp.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+#include "eth-test-payload.h"
+#include "eth-test-send.h"
+
+/* Clock to timestamp the packets with. */
+clockid_t send_clock = CLOCK_REALTIME;
+
+static uint64_t timestamp(void) {
+  struct timespec ts;
+  clock_gettime(send_clock, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double seconds(void) {
+  return now_ns() / 1e9;
+}
+
+/* tell the receiver at `addr' (or the connected one, if NULL) that `last_packet_nr' was the last packet */
+static void send_eos(int fd, const struct sockaddr_in *addr, size_t last_packet_nr) {
+  struct message eos;
+  int i;
+
+  eos.packet_nr = EOS_PACKET_NR;
+  eos.send_time = last_packet_nr;
+
+  for( i = 0; i < EOS_MARKERS; i++ ) {
+    (void)sendto(fd, &eos, offsetof(struct message, payload), 0, (const struct sockaddr *)addr, addr ? sizeof *addr : 0);
+  }
+}
+
+/* send msgs[0..n) with as few sendmmsg() calls as possible, and return how many
+ * were sent. If not all of them, set *err to the error that stopped us. */
+static int send_all(int fd, struct mmsghdr *msgs, int n, int *err) {
+  int sent_msgs = 0;
+
+  /* a pending error (f.e. ECONNREFUSED from a closed port) cuts a call short:
+   * send the rest now, instead of constructing them again */
+  while( sent_msgs < n ) {
+    const int more = sendmmsg(fd, &msgs[sent_msgs], n - sent_msgs, 0);
+
+    if (more <= 0) {
+      *err = errno;
+      break;
+    }
+
+    sent_msgs += more;
+  }
+
+  return sent_msgs;
+}
+
+static void print_send_errors(const struct send_report *report) {
+  if (report->send_errors > 0)
+    printf("Could not send %ld packets, last error: %s\n", report->send_errors, strerror(report->last_errno));
+}
+
+/* send one packet per sendmsg(), sleeping before each packet */
+struct send_report send_single(const char *hostStr, unsigned short port, double speed_bps, int verify) {
+  struct send_report result = { 0.0, 0.0 };
+  int fd = create_udp_socket(hostStr, port, 0);
+  int i;
+
+  struct message buffer[MSG_BATCHSIZE];
+
+  /* setup sendmsg/recvmmsg structures */
+  struct iovec iov[MSG_BATCHSIZE];
+  struct mmsghdr msgs[MSG_BATCHSIZE];
+
+  for( i = 0; i < MSG_BATCHSIZE; i++ ) {
+    iov[i].iov_base = &buffer[i];
+    iov[i].iov_len  = MAX_MSGSIZE;
+    msgs[i].msg_hdr.msg_name    = NULL;
+    msgs[i].msg_hdr.msg_namelen = 0;
+    msgs[i].msg_hdr.msg_iov     = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen  = 1;
+    msgs[i].msg_hdr.msg_control = NULL;
+    msgs[i].msg_hdr.msg_controllen = 0;
+    msgs[i].msg_hdr.msg_flags   = 0;
+  }
+
+#pragma omp barrier
+  printf("Sending UDP packets...\n");
+  size_t packet_nr = 0;
+  struct pacer pacer;
+  pacer_init(&pacer, PACER_SPIN_NS);
+
+  const uint64_t first_packet_timestamp = now_ns();
+
+  size_t late = 0;
+  double begin = seconds();
+
+  while( packet_nr < NR_BATCHES * MSG_BATCHSIZE * 2 ) { /* overshoot to allow for some loss */
+    packet_nr ++;
+
+    /* wait for deadline of next packet according to desired data rate */
+    late += pacer_wait(&pacer, first_packet_timestamp + (uint64_t)(1e9 * packet_nr * MAX_MSGSIZE / (speed_bps / 8)));
+
+    /* construct and send one packet */
+    buffer[0].packet_nr = packet_nr;
+    buffer[0].send_time = timestamp();
+    if (verify)
+      payload_fill(&buffer[0], MAX_MSGSIZE);
+    if (sendmsg(fd, &msgs[0].msg_hdr, 0) < 0) {
+      result.send_errors++;
+      result.last_errno = errno;
+    }
+  }
+
+  /* report */
+  result.nr_packets = packet_nr - result.send_errors;
+  result.speed_gbps = result.nr_packets * MAX_MSGSIZE / GBPS / (seconds() - begin);
+  result.late_perc  = 100.0 * late / packet_nr;
+  result.nr_calls   = packet_nr;
+  result.max_batch  = 1;
+  result.batch_hist[0] = packet_nr;
+  result.lateness   = pacer.lateness;
+
+  printf("Sent %ld packets, %.2f%% late.\n", result.nr_packets, 100.0*late/packet_nr);
+  print_send_errors(&result);
+
+  /* Teardown */
+  send_eos(fd, NULL, packet_nr);
+  close(fd);
+
+  return result;
+}
+
+/* send packets with sendmmsg(), paced by a token bucket.
+ *
+ * The bucket fills at the desired rate, and holds at most `max_batch' packets.
+ * Instead of sleeping for every packet, we sleep until enough tokens are
+ * available to cover the time we typically oversleep, and send those packets
+ * in a single call. A bucket that overflows means we fell behind, and those
+ * packets are counted as late.
+ *
+ * The calls rotate over `nr_flows' sockets, each with its own source port, so
+ * a receiver can spread the port over several readers.
+ *
+ * If `gso_segs' > 1, up to that many packets are sent as one super-packet,
+ * which the kernel or NIC splits up (UDP GSO). We then wait for at least one
+ * full super-packet before sending.
+ *
+ * If `verify' is set, every payload is filled with a pattern and a CRC32C.
+ */
+struct send_report send_bucket(const char *hostStr, unsigned short port, double speed_bps, size_t max_batch, int nr_flows, int gso_segs, int verify) {
+  struct send_report result = { 0.0, 0.0 };
+  int fds[MAX_FLOWS];
+  int flow = 0;
+  int i, k;
+
+  for( i = 0; i < nr_flows; i++ ) {
+    fds[i] = create_udp_socket(hostStr, port, 0);
+
+    if (gso_segs > 1) {
+      const int gso_size = MAX_MSGSIZE;
+
+      checkSyscall("setsockopt(UDP_SEGMENT)",
+        setsockopt(fds[i], SOL_UDP, UDP_SEGMENT, &gso_size, sizeof gso_size));
+    }
+  }
+
+  struct message buffer[MSG_BATCHSIZE];
+
+  /* setup sendmmsg structures */
+  struct iovec iov[MSG_BATCHSIZE];
+  struct mmsghdr msgs[MSG_BATCHSIZE];
+
+  for( i = 0; i < MSG_BATCHSIZE; i++ ) {
+    iov[i].iov_base = &buffer[i];
+    iov[i].iov_len  = MAX_MSGSIZE;
+    msgs[i].msg_hdr.msg_name    = NULL;
+    msgs[i].msg_hdr.msg_namelen = 0;
+    msgs[i].msg_hdr.msg_iov     = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen  = 1;
+    msgs[i].msg_hdr.msg_control = NULL;
+    msgs[i].msg_hdr.msg_controllen = 0;
+    msgs[i].msg_hdr.msg_flags   = 0;
+  }
+
+  const size_t nr_packets = NR_BATCHES * MSG_BATCHSIZE * 2; /* overshoot to allow for some loss */
+  const double rate = speed_bps / 8.0; /* bytes/second */
+  const double depth = (double)max_batch * MAX_MSGSIZE;
+
+#pragma omp barrier
+  printf("Sending UDP packets...\n");
+  size_t packet_nr = 0;
+  size_t late = 0;
+  struct pacer pacer;
+  double overshoot = 0.0;
+
+  pacer_init(&pacer, PACER_SPIN_NS);
+
+  /* number of packets to wait for before sending */
+  const size_t min_target = gso_segs < max_batch ? gso_segs : max_batch;
+  size_t target = min_target;
+
+  double tokens = MAX_MSGSIZE;
+  double begin = seconds(), last = begin;
+
+  while( packet_nr < nr_packets ) {
+    /* refill the bucket */
+    double now = seconds();
+    tokens += (now - last) * rate;
+    last = now;
+
+    if (tokens > depth) {
+      late += (size_t)((tokens - depth) / MAX_MSGSIZE);
+      tokens = depth;
+    }
+
+    size_t n = tokens / MAX_MSGSIZE;
+
+    if (n < target) {
+      /* sleep until `target' packets may be sent */
+      const double deadline = now + (target * MAX_MSGSIZE - tokens) / rate;
+
+      pacer_wait(&pacer, (uint64_t)(deadline * 1e9));
+
+      /* adapt the batch size to how late we wake up, averaged over the last few sleeps */
+      const double this_overshoot = seconds() - deadline;
+      overshoot = 0.9 * overshoot + 0.1 * (this_overshoot > 0.0 ? this_overshoot : 0.0);
+
+      target = 1 + (size_t)(overshoot * rate / MAX_MSGSIZE);
+      if (target < min_target) target = min_target;
+      if (target > max_batch) target = max_batch;
+      continue;
+    }
+
+    if (n > max_batch) n = max_batch;
+    if (n > nr_packets - packet_nr) n = nr_packets - packet_nr;
+
+    /* construct and send a batch of packets */
+    const uint64_t send_time = timestamp();
+
+    for( i = 0; i < n; i++ ) {
+      buffer[i].packet_nr = packet_nr + i + 1;
+      buffer[i].send_time = send_time;
+      if (verify)
+        payload_fill(&buffer[i], MAX_MSGSIZE);
+    }
+
+    /* group the packets into (super-)packets of up to gso_segs packets each */
+    const int nr_msgs = (n + gso_segs - 1) / gso_segs;
+
+    for( k = 0; k < nr_msgs; k++ ) {
+      msgs[k].msg_hdr.msg_iov    = &iov[k * gso_segs];
+      msgs[k].msg_hdr.msg_iovlen = n - k * gso_segs < gso_segs ? n - k * gso_segs : gso_segs;
+    }
+
+    const int sent_msgs = send_all(fds[flow], msgs, nr_msgs, &result.last_errno);
+    size_t sent = 0;
+
+    flow = (flow + 1) % nr_flows;
+
+    for( k = 0; k < sent_msgs; k++ ) {
+      sent += msgs[k].msg_hdr.msg_iovlen;
+    }
+
+    /* unsent packets keep their numbers, so the receiver sees them as lost */
+    result.send_errors += n - sent;
+
+    packet_nr += n;
+    tokens    -= (double)n * MAX_MSGSIZE;
+
+    /* record burstiness */
+    int bucket = 63 - __builtin_clzll(n);
+    result.batch_hist[bucket < BATCH_BUCKETS ? bucket : BATCH_BUCKETS - 1]++;
+    if (n > result.max_batch) result.max_batch = n;
+    result.nr_calls++;
+  }
+
+  /* report */
+  const double elapsed = seconds() - begin;
+
+  result.nr_packets = packet_nr - result.send_errors;
+  result.speed_gbps = result.nr_packets * MAX_MSGSIZE / GBPS / elapsed;
+  result.late_perc  = 100.0 * late / packet_nr;
+  result.lateness   = pacer.lateness;
+
+  printf("Sent %ld packets in %ld calls (%.1f packets/call, max %ld) at %.2f Gbit/s, %.2f%% late, woke up %.1f us late on average.\n",
+    result.nr_packets,
+    result.nr_calls,
+    (double)packet_nr / result.nr_calls,
+    result.max_batch,
+    result.speed_gbps,
+    result.late_perc,
+    hist_mean(&result.lateness) / 1e3);
+  print_send_errors(&result);
+
+  /* Teardown */
+  send_eos(fds[0], NULL, packet_nr);
+  for( i = 0; i < nr_flows; i++ ) {
+    close(fds[i]);
+  }
+
+  return result;
+}
+
+/* A port sent to by send_wheel(). */
+struct wheel_stream {
+  struct sockaddr_in addr;
+  unsigned short port;
+  uint64_t first;     /* deadline of packet 0, in ns on CLOCK_MONOTONIC */
+  uint64_t deadline;  /* of the next packet */
+  size_t packet_nr;   /* of the last packet sent */
+  size_t late;        /* packets sent more than a tick after their deadline */
+  uint64_t end;       /* time the last packet was sent */
+  int next;           /* next stream in the same slot, or -1 */
+};
+
+/* link stream `s' into the slot of its deadline, but not before tick `min_tick' */
+static void wheel_insert(int *slots, struct wheel_stream *streams, int s, uint64_t min_tick) {
+  uint64_t tick = streams[s].deadline / WHEEL_TICK_NS;
+
+  if (tick < min_tick)
+    tick = min_tick;
+
+  streams[s].next = slots[tick % WHEEL_SLOTS];
+  slots[tick % WHEEL_SLOTS] = s;
+}
+
+/* return the thread'th CPU we may run on */
+static int wheel_cpu(int thread) {
+  cpu_set_t cpuset;
+  int cpu, nr_cpus = 0;
+
+  checkSyscall("sched_getaffinity()", sched_getaffinity(0, sizeof cpuset, &cpuset));
+
+  const int nr_allowed = CPU_COUNT(&cpuset);
+
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpuset) && nr_cpus++ == thread % nr_allowed)
+      return cpu;
+  }
+
+  return -1;
+}
+
+/* send the n packets in msgs[], and account for the call in the report of the stream of the first one */
+static void wheel_flush(int fd, struct mmsghdr *msgs, size_t n, const int *owner, struct send_report *reports) {
+  int k;
+  int err = 0;
+  const int sent_msgs = send_all(fd, msgs, n, &err);
+
+  /* unsent packets are accounted to their own streams */
+  for( k = sent_msgs; k < n; k++ ) {
+    reports[owner[k]].send_errors++;
+    reports[owner[k]].last_errno = err;
+  }
+
+  struct send_report *r = &reports[owner[0]];
+  const int bucket = 63 - __builtin_clzll(n);
+
+  r->batch_hist[bucket < BATCH_BUCKETS ? bucket : BATCH_BUCKETS - 1]++;
+  if (n > r->max_batch) r->max_batch = n;
+  r->nr_calls++;
+}
+
+/* send packets to several ports from one thread, scheduled on a hashed timing wheel.
+ *
+ * Every port (stream) sends at its own constant rate, with deadlines relative to
+ * its own start, so streams do not drift against each other. Streams start
+ * evenly spread over one packet interval, so their packets interleave.
+ *
+ * Each stream is linked into the slot of the tick of its next deadline. Deadlines
+ * more than WHEEL_SLOTS ticks ahead stay in their slot until their revolution
+ * comes. Once a tick has passed, the due packets in its slot are sent in one
+ * sendmmsg() call, and their streams move on to the slot of their next deadline.
+ * Empty slots are skipped without waking up.
+ *
+ * If the thread wakes up late, the slots of all ticks that passed are sent
+ * together, in calls of up to max_batch packets. A stream that fell behind
+ * sends a packet per passed tick until it has caught up, and those count
+ * as late.
+ */
+void send_wheel(const char *hostStr, const unsigned short *ports, int nr_ports, double speed_bps, size_t msg_size, size_t nr_packets, size_t max_batch, int cpu, int verify, struct send_report *reports) {
+  struct wheel_stream *streams = calloc(nr_ports, sizeof *streams);
+  struct message *buffer = malloc(max_batch * sizeof *buffer);
+  struct iovec *iov = malloc(max_batch * sizeof *iov);
+  struct mmsghdr *msgs = calloc(max_batch, sizeof *msgs);
+  int *owner = malloc(max_batch * sizeof *owner);
+  int slots[WHEEL_SLOTS];
+  int fd = -1;
+  int i, s;
+
+  if (!streams || !buffer || !iov || !msgs || !owner) {
+    printf("ERROR: Could not allocate wheel of %d ports.\n", nr_ports);
+    exit(EXIT_FAILURE);
+  }
+
+  if (cpu >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    checkSyscall("sched_setaffinity()", sched_setaffinity(0, sizeof cpuset, &cpuset));
+  }
+
+  for( s = 0; s < nr_ports; s++ ) {
+    struct sockaddr_in addr;
+    const int sfd = create_unconnected_udp_socket(hostStr, ports[s], &addr);
+
+    /* all ports resolve to the same host, so one socket sends to all of them */
+    if (fd < 0)
+      fd = sfd;
+    else
+      close(sfd);
+
+    streams[s].addr = addr;
+    streams[s].port = ports[s];
+    memset(&reports[s], 0, sizeof reports[s]);
+    hist_init(&reports[s].lateness);
+  }
+
+  for( i = 0; i < max_batch; i++ ) {
+    iov[i].iov_base = &buffer[i];
+    iov[i].iov_len  = msg_size;
+    msgs[i].msg_hdr.msg_iov    = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  const double interval_ns = 1e9 * msg_size / (speed_bps / 8);
+
+#pragma omp barrier
+
+  struct pacer pacer;
+  pacer_init(&pacer, PACER_SPIN_NS);
+
+  const uint64_t begin = now_ns();
+
+  for( i = 0; i < WHEEL_SLOTS; i++ ) {
+    slots[i] = -1;
+  }
+
+  for( s = 0; s < nr_ports; s++ ) {
+    streams[s].first    = begin + (uint64_t)(interval_ns * s / nr_ports);
+    streams[s].deadline = streams[s].first + (uint64_t)interval_ns;
+    wheel_insert(slots, streams, s, 0);
+  }
+
+  uint64_t tick = begin / WHEEL_TICK_NS;
+  int nr_active = nr_ports;
+
+  while( nr_active > 0 ) {
+    /* skip to the next slot with streams in it */
+    for( i = 0; i < WHEEL_SLOTS && slots[tick % WHEEL_SLOTS] < 0; i++ ) {
+      tick++;
+    }
+
+    /* wait until all deadlines in this tick have passed */
+    pacer_wait(&pacer, (tick + 1) * WHEEL_TICK_NS);
+
+    const uint64_t now = now_ns();
+    const uint64_t send_time = timestamp();
+    const uint64_t last_tick = now / WHEEL_TICK_NS - 1;
+    size_t n = 0;
+
+    /* take all ticks that passed, so a thread that fell behind catches up in full batches */
+    for( ; tick <= last_tick && nr_active > 0; tick++ ) {
+      s = slots[tick % WHEEL_SLOTS];
+      slots[tick % WHEEL_SLOTS] = -1;
+
+      while( s >= 0 ) {
+        struct wheel_stream *st = &streams[s];
+        const int next = st->next;
+
+        if (st->deadline / WHEEL_TICK_NS > tick) {
+          /* due in a later revolution */
+          st->next = slots[tick % WHEEL_SLOTS];
+          slots[tick % WHEEL_SLOTS] = s;
+          s = next;
+          continue;
+        }
+
+        /* send all its packets due in this tick, so a fast stream is not limited to one per tick */
+        do {
+          if (n == max_batch) {
+            wheel_flush(fd, msgs, n, owner, reports);
+            n = 0;
+          }
+
+          /* construct its next packet */
+          st->packet_nr++;
+
+          buffer[n].packet_nr = st->packet_nr;
+          buffer[n].send_time = send_time;
+          if (verify)
+            payload_fill(&buffer[n], msg_size);
+
+          msgs[n].msg_hdr.msg_name    = &st->addr;
+          msgs[n].msg_hdr.msg_namelen = sizeof st->addr;
+          owner[n] = s;
+          n++;
+
+          hist_add(&reports[s].lateness, now - st->deadline);
+          if (now - st->deadline > WHEEL_TICK_NS)
+            st->late++;
+
+          st->deadline = st->first + (uint64_t)(interval_ns * (st->packet_nr + 1));
+        } while (st->packet_nr < nr_packets && st->deadline < (tick + 1) * WHEEL_TICK_NS);
+
+        if (st->packet_nr == nr_packets) {
+          st->end = now;
+          nr_active--;
+        } else {
+          wheel_insert(slots, streams, s, tick + 1);
+        }
+
+        s = next;
+      }
+    }
+
+    if (n > 0)
+      wheel_flush(fd, msgs, n, owner, reports);
+  }
+
+  /* report */
+  for( s = 0; s < nr_ports; s++ ) {
+    struct send_report *r = &reports[s];
+    const double elapsed = (streams[s].end - streams[s].first) / 1e9;
+
+    r->nr_packets = streams[s].packet_nr - r->send_errors;
+    r->speed_gbps = r->nr_packets * msg_size / GBPS / elapsed;
+    r->late_perc  = 100.0 * streams[s].late / r->nr_packets;
+  }
+
+  /* Teardown */
+  for( s = 0; s < nr_ports; s++ ) {
+    send_eos(fd, &streams[s].addr, streams[s].packet_nr);
+  }
+
+  close(fd);
+  free(owner);
+  free(msgs);
+  free(iov);
+  free(buffer);
+  free(streams);
+}
+
+void wheel_thread(const char *hostStr, unsigned short first_port, int nr_ports, int wheel, int nr_wheels, double speed_bps, size_t msg_size, size_t nr_packets, size_t max_batch, int verify, struct send_report *reports) {
+  unsigned short ports[nr_ports];
+  struct send_report wheel_reports[nr_ports];
+  int i, n = 0;
+
+  for( i = wheel; i < nr_ports; i += nr_wheels ) {
+    ports[n++] = first_port + i;
+  }
+
+  send_wheel(hostStr, ports, n, speed_bps, msg_size, nr_packets, max_batch, wheel_cpu(wheel), verify, wheel_reports);
+
+  for( i = 0; i < n; i++ ) {
+    reports[wheel + i * nr_wheels] = wheel_reports[i];
+  }
+}
+
+void wheel_print(const struct send_report *reports, unsigned short first_port, int nr_ports, double speed_bps) {
+  int i;
+
+  for( i = 0; i < nr_ports; i++ ) {
+    printf("Port %d: sent %ld packets at %.3f Gbit/s (rate error %+.3f%%), %.2f%% late, sent %.1f us after the deadline on average.\n",
+      first_port + i,
+      reports[i].nr_packets,
+      reports[i].speed_gbps,
+      100.0 * (reports[i].speed_gbps * 1e9 - speed_bps) / speed_bps,
+      reports[i].late_perc,
+      hist_mean(&reports[i].lateness) / 1e3);
+    print_send_errors(&reports[i]);
+  }
+}
+
+struct send_report send_summary(const struct send_report *reports, int nr_reports, double desired_bps) {
+  struct send_report totals = { 0.0, 0.0 };
+  int i;
+
+  printf(" ----- Send results -----\n");
+  hist_init(&totals.lateness);
+  for ( i = 0; i < nr_reports; i++ ) {
+    int b;
+
+    totals.speed_gbps += reports[i].speed_gbps; /* sum */
+    totals.late_perc  += reports[i].late_perc / nr_reports; /* average */
+    totals.nr_packets += reports[i].nr_packets; /* sum */
+    totals.nr_calls   += reports[i].nr_calls; /* sum */
+    totals.send_errors += reports[i].send_errors; /* sum */
+    if (reports[i].send_errors > 0) totals.last_errno = reports[i].last_errno;
+    hist_merge(&totals.lateness, &reports[i].lateness);
+    if (reports[i].max_batch > totals.max_batch) totals.max_batch = reports[i].max_batch; /* max */
+
+    for ( b = 0; b < BATCH_BUCKETS; b++ )
+      totals.batch_hist[b] += reports[i].batch_hist[b]; /* sum */
+  }
+
+  printf("Desired speed:  %.2f Gbit/s\n", nr_reports * desired_bps / 1e9);
+  printf("Achieved speed: %.2f Gbit/s\n", totals.speed_gbps);
+  printf("Average late:   %.3f%%\n", totals.late_perc);
+  printf("Packets/call:   %.1f (max %ld)\n", (double)totals.nr_packets / totals.nr_calls, totals.max_batch);
+  print_send_errors(&totals);
+  hist_print("Wake-up delay: ", &totals.lateness, 1e3, "us");
+  for ( i = 0; i < BATCH_BUCKETS; i++ ) {
+    if (totals.batch_hist[i] == 0)
+      continue;
+
+    if (i == 0)
+      printf("Batches of 1: %ld\n", totals.batch_hist[i]);
+    else
+      printf("Batches of %lu-%lu: %ld\n", 1UL << i, (2UL << i) - 1, totals.batch_hist[i]);
+  }
+
+  return totals;
+}
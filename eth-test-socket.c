@@ -0,0 +1,364 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+#include "eth-test-control.h"
+#include "eth-test-receive.h"
+
+struct report receive_data(const char *hostStr, unsigned short port, timestamp_t timestamps, int gro, int verify, wait_mode_t wait, int idleMs, struct series *series, const char *recordPrefix, size_t recordBufferSize) {
+  struct report result = { 0.0, 0.0 };
+  struct seq_window window;
+  struct recv_batch *batch = batch_alloc(gro, timestamps, verify);
+  size_t corrupt = 0;
+
+  int fd = create_udp_socket(hostStr, port, 1);
+  int j;
+
+  enable_timestamps(fd, hostStr, timestamps);
+  if (gro)
+    enable_gro(fd);
+  set_wait_mode(fd, wait);
+
+  latency_init(&result.latency);
+
+  struct recorder recorder;
+  char recordPath[1024];
+
+  if (recordPrefix) {
+    snprintf(recordPath, sizeof recordPath, "%s.%u", recordPrefix, port);
+    recorder_open(&recorder, recordPath, recordBufferSize);
+  }
+
+#pragma omp barrier
+  /* wait for the first message, unless the other ports started long ago */
+  printf("Waiting for first UDP packet...\n");
+  struct timespec now;
+  do {
+    batch_wait(batch, fd, 1, wait, NULL);
+    corrupt += batch->nr_corrupt;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while (batch->nr_packets == 0 && !never_started(&now, (uint64_t)idleMs * 1000000));
+
+  if (batch->nr_packets == 0) {
+    printf("No UDP packets for %d ms after the other ports started, giving up.\n", idleMs);
+
+    report_all_lost(&result, (size_t)NR_BATCHES * MSG_BATCHSIZE);
+    result.corrupt   = corrupt;
+    result.timed_out = 1;
+
+    if (recordPrefix)
+      result.record = recorder_close(&recorder);
+
+    close(fd);
+    batch_free(batch);
+
+    return result;
+  }
+
+  mark_first_arrival(&now);
+
+  /* packets coalesced with the first one are accounted for, but not timed */
+  seq_window_init(&window, batch->packet_nrs[0]);
+  for( j = 1; j < batch->nr_packets; j++ ) {
+    seq_window_add(&window, batch->packet_nrs[j]);
+  }
+
+  /* send/receive messages */
+  printf("Receiving UDP packets...\n");
+
+  const size_t target = (size_t)NR_BATCHES * MSG_BATCHSIZE;
+  size_t total_num_bytes = 0, total_num_msgs = 0, total_num_datagrams = 0;
+  double cpu_begin = thread_cpu_seconds();
+
+  struct perf_counters counters;
+  perf_open(&counters);
+  perf_start(&counters);
+
+  /* the measurement runs from here until the last arrival */
+  const uint64_t begin = now_ns();
+  uint64_t last = begin;
+
+  while (total_num_msgs < target) {
+    const int num_datagrams = batch_wait(batch, fd, MSG_BATCHSIZE, wait, &result.latency);
+
+    if (num_datagrams == 0) {
+      if (now_ns() - last > (uint64_t)idleMs * 1000000) {
+        result.timed_out = 1;
+        printf("No UDP packets for %d ms, giving up.\n", idleMs);
+        break;
+      }
+      continue;
+    }
+
+    if (batch->nr_packets + batch->nr_corrupt > 0)
+      last = now_ns();
+
+    /* accumulate result */
+    for( j = 0; j < batch->nr_packets; j++ ) {
+      seq_window_add(&window, batch->packet_nrs[j]);
+    }
+
+    if (recordPrefix) {
+      for( j = 0; j < num_datagrams; j++ ) {
+        recorder_add(&recorder, batch->iov[j].iov_base, batch->msgs[j].msg_len);
+      }
+    }
+
+    total_num_bytes     += batch->nr_bytes;
+    total_num_msgs      += batch->nr_packets + batch->nr_corrupt;
+    corrupt             += batch->nr_corrupt;
+    total_num_datagrams += num_datagrams;
+
+    series_update(series, total_num_bytes, window.received + window.lost, window.lost);
+
+    /* packets after the marker are lost, as the sender has stopped */
+    if (batch->eos) {
+      seq_window_end(&window, batch->eos_last);
+      result.eos = 1;
+      printf("The sender ended the stream early.\n");
+      break;
+    }
+  }
+  const double seconds = last > begin ? (last - begin) / 1e9 : 1e-9;
+  perf_stop(&counters, &result.perf);
+  perf_close(&counters);
+
+  /* report speed */
+  result.seq = seq_window_finish(&window);
+  result.corrupt = corrupt;
+  discount_corrupt(&result);
+  result.speed_gbps = total_num_bytes/GBPS/seconds;
+  result.loss_perc  = 100.0 * result.seq.lost / result.seq.expected;
+  result.cpu_perc   = 100.0 * (thread_cpu_seconds() - cpu_begin) / seconds;
+  result.nr_bytes   = total_num_bytes;
+
+  printf("Received %.2f GByte over %.2f seconds. Speed: %.2f Gbit/s, using %.1f%% CPU\n",
+    total_num_bytes/GBYTE,
+    seconds,
+    total_num_bytes/GBPS/seconds,
+    result.cpu_perc);
+  printf("Received %ld messages in %ld datagrams, lost %ld of %ld messages (%ld late, %ld duplicate, %ld stale), longest burst %ld, %ld corrupt.\n",
+    total_num_msgs,
+    total_num_datagrams,
+    result.seq.lost,
+    result.seq.expected,
+    result.seq.late,
+    result.seq.duplicate,
+    result.seq.stale,
+    result.seq.max_burst,
+    result.corrupt);
+
+  if (timestamps != TS_NONE)
+    latency_print("", &result.latency);
+
+  perf_print("Counters:", &result.perf, total_num_bytes);
+
+  if (recordPrefix) {
+    result.record = recorder_close(&recorder);
+
+    printf("Recorded %.2f GByte to %s%s at %.1f MB/s, writing %.1f%% of the time. Peak buffer use %lu of %d, dropped %lu datagrams.\n",
+      result.record.nr_bytes/GBYTE,
+      recordPath,
+      result.record.direct ? " (O_DIRECT)" : "",
+      result.record.seconds > 0.0 ? result.record.nr_bytes/1e6/result.record.seconds : 0.0,
+      result.record.seconds > 0.0 ? 100.0 * result.record.write_seconds / result.record.seconds : 0.0,
+      result.record.peak_buffers,
+      RECORD_BUFFERS,
+      result.record.dropped_msgs);
+  }
+
+  /* Teardown */
+  close(fd);
+  batch_free(batch);
+
+  return result;
+}
+
+size_t read_port(const char *hostStr, unsigned short port, struct port_state *p, int cpu, int steer, timestamp_t timestamps, int gro, int verify, wait_mode_t wait, int idleMs, struct latency *latency, double *cpu_seconds, struct perf_values *perf) {
+  const size_t target = (size_t)NR_BATCHES * MSG_BATCHSIZE;
+  struct recv_batch *batch = batch_alloc(gro, timestamps, verify);
+  size_t nr_msgs = 0;
+
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  checkSyscall("sched_setaffinity()", sched_setaffinity(0, sizeof cpuset, &cpuset));
+
+  int fd = create_shared_udp_socket(hostStr, port, steer ? cpu : -1);
+
+  enable_timestamps(fd, hostStr, timestamps);
+  if (gro)
+    enable_gro(fd);
+  set_wait_mode(fd, wait);
+
+  struct perf_counters counters;
+  struct perf_values values;
+  perf_open(&counters);
+
+#pragma omp barrier
+  const double cpu_begin = thread_cpu_seconds();
+  perf_start(&counters);
+
+  while (!__atomic_load_n(&p->done, __ATOMIC_RELAXED)) {
+    const int num_datagrams = batch_wait(batch, fd, MSG_BATCHSIZE, wait, latency);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (num_datagrams == 0) {
+      port_check_idle(p, &now, (uint64_t)idleMs * 1000000);
+      continue;
+    }
+
+    if (batch->nr_packets + batch->nr_corrupt > 0) {
+      port_add(p, batch->packet_nrs, batch->nr_packets, batch->nr_corrupt, batch->nr_bytes, &now, target);
+      nr_msgs += batch->nr_packets + batch->nr_corrupt;
+    }
+
+    if (batch->eos)
+      port_end(p, batch->eos_last);
+  }
+
+  *cpu_seconds += thread_cpu_seconds() - cpu_begin;
+  perf_stop(&counters, &values);
+  perf_values_add(perf, &values);
+  perf_close(&counters);
+
+  /* Teardown */
+  close(fd);
+  batch_free(batch);
+
+  return nr_msgs;
+}
+
+/* receive one port of trial `t', and return what arrived, and when the first and last packet did */
+static struct trial_result receive_trial(const char *hostStr, unsigned short port, const struct trial *t, wait_mode_t wait, int idleMs, int ctl, uint64_t *first, uint64_t *last) {
+  struct trial_result result = { t->nr_packets, 0, 0, 0, 0 };
+  struct recv_batch *batch = batch_alloc(0, TS_NONE, t->verify);
+  struct seq_window window;
+  int started = 0;
+  int j;
+
+  int fd = create_udp_socket(hostStr, port, 1);
+  set_wait_mode(fd, wait);
+
+  /* tell the sender once all ports are bound */
+#pragma omp barrier
+#pragma omp single
+  {
+    const struct trial_ready ready = { t->nr_ports };
+    control_send(ctl, &ready, sizeof ready);
+  }
+
+  uint64_t idle_since = now_ns();
+  *first = *last = 0;
+
+  for (;;) {
+    const int num_datagrams = batch_wait(batch, fd, MSG_BATCHSIZE, wait, NULL);
+    const uint64_t now = now_ns();
+
+    if (num_datagrams == 0) {
+      if (now - idle_since > (uint64_t)idleMs * 1000000)
+        break;
+      continue;
+    }
+
+    if (batch->nr_packets + batch->nr_corrupt > 0) {
+      if (!*first)
+        *first = now;
+      *last = now;
+      idle_since = now;
+    }
+
+    for (j = 0; j < batch->nr_packets; j++) {
+      if (!started) {
+        seq_window_init(&window, batch->packet_nrs[j]);
+        started = 1;
+      } else {
+        seq_window_add(&window, batch->packet_nrs[j]);
+      }
+    }
+
+    result.corrupt  += batch->nr_corrupt;
+    result.nr_bytes += batch->nr_bytes;
+
+    if (batch->eos || (started && window.received >= t->nr_packets))
+      break;
+  }
+
+  if (started)
+    result.received = window.received;
+
+  /* Teardown */
+  close(fd);
+  batch_free(batch);
+
+  return result;
+}
+
+void serve_trials(const char *hostStr, unsigned short firstPort, unsigned short controlPort, wait_mode_t wait, int idleMs) {
+  struct trial t;
+  int nr_trials = 0;
+  int i;
+
+  printf("Waiting for eth-test-send on TCP port %u...\n", controlPort);
+  const int ctl = control_accept(hostStr, controlPort);
+
+  while (control_recv(ctl, &t, sizeof t) && t.nr_ports > 0) {
+    if (t.nr_ports > MAX_TRIAL_PORTS || t.msg_size < MIN_MSGSIZE || t.msg_size > MAX_MSGSIZE) {
+      printf("ERROR: Invalid trial of %lu ports of %lu bytes.\n", t.nr_ports, t.msg_size);
+      exit(EXIT_FAILURE);
+    }
+
+    const int nrPorts = t.nr_ports;
+    struct trial_result results[nrPorts];
+    uint64_t first[nrPorts], last[nrPorts];
+
+#pragma omp parallel num_threads(nrPorts)
+    {
+      const int port = omp_get_thread_num();
+
+      results[port] = receive_trial(hostStr, firstPort + port, &t, wait, idleMs, ctl, &first[port], &last[port]);
+    }
+
+    /* sum over all ports, and time from the first to the last arrival on any port */
+    struct trial_result totals = { 0, 0, 0, 0, 0 };
+    uint64_t begin = 0, end = 0;
+
+    for (i = 0; i < nrPorts; i++) {
+      totals.expected += results[i].expected;
+      totals.received += results[i].received;
+      totals.corrupt  += results[i].corrupt;
+      totals.nr_bytes += results[i].nr_bytes;
+
+      if (first[i] && (!begin || first[i] < begin))
+        begin = first[i];
+      if (last[i] > end)
+        end = last[i];
+    }
+
+    totals.duration_ns = end - begin;
+    control_send(ctl, &totals, sizeof totals);
+
+    printf("Trial %d: %d ports of %lu bytes: received %lu of %lu packets, %lu corrupt, at %.3f Gbit/s\n",
+      ++nr_trials,
+      nrPorts,
+      t.msg_size,
+      totals.received,
+      totals.expected,
+      totals.corrupt,
+      totals.duration_ns > 0 ? totals.nr_bytes / GBPS / (totals.duration_ns / 1e9) : 0.0);
+  }
+
+  close(ctl);
+  printf("Ran %d trials.\n", nr_trials);
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "common.h"
+#include "eth-test-params.h"
+#include "eth-test-control.h"
+#include "eth-test-send.h"
+
+/* Minimum number of packets per port in a trial, to measure loss with. */
+#define MIN_TRIAL_PACKETS 1000
+
+/* Fraction of the requested rate the sender must reach for a trial to test that rate. */
+#define MIN_SENT_FRACTION 0.99
+
+/* Result of a trial. */
+struct trial_outcome {
+  enum { TRIAL_LOSSLESS, TRIAL_LOSSY, TRIAL_SENDER_SHORT } verdict;
+  double sent_gbps;      /* achieved by the sender, total */
+  double received_gbps;  /* over the duration of the reception */
+};
+
+int parse_sweep_list(const char *str, long *values, int max) {
+  char copy[256], *item, *save, *end;
+  int n = 0;
+
+  if (strlen(str) >= sizeof copy)
+    return -1;
+
+  strcpy(copy, str);
+
+  for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+    if (n == max)
+      return -1;
+
+    values[n] = strtol(item, &end, 10);
+    if (*end || values[n] <= 0)
+      return -1;
+
+    n++;
+  }
+
+  return n > 0 ? n : -1;
+}
+
+/* run one trial of nr_ports ports of msg_size bytes at total_bps */
+static struct trial_outcome run_trial(const struct sweep_config *c, int ctl, int nr_ports, size_t msg_size, double total_bps) {
+  struct trial_outcome outcome = { TRIAL_LOSSY, 0.0, 0.0 };
+  const double port_bps = total_bps / nr_ports;
+  size_t nr_packets = port_bps / 8 * c->trial_ms / 1000 / msg_size;
+  int i;
+
+  if (nr_packets < MIN_TRIAL_PACKETS)
+    nr_packets = MIN_TRIAL_PACKETS;
+
+  /* let the receiver bind the ports */
+  const struct trial t = { nr_ports, msg_size, nr_packets, c->verify };
+  struct trial_ready ready;
+
+  control_send(ctl, &t, sizeof t);
+  if (!control_recv(ctl, &ready, sizeof ready) || ready.nr_ports != nr_ports) {
+    printf("ERROR: The receiver did not start the trial.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* send */
+  const int nr_wheels = c->nr_wheels < nr_ports ? c->nr_wheels : nr_ports;
+  struct send_report reports[nr_ports];
+
+#pragma omp parallel num_threads(nr_wheels)
+  wheel_thread(c->host, c->first_port, nr_ports, omp_get_thread_num(), nr_wheels, port_bps, msg_size, nr_packets, c->max_batch, c->verify, reports);
+
+  for (i = 0; i < nr_ports; i++) {
+    outcome.sent_gbps += reports[i].speed_gbps;
+  }
+
+  /* collect what arrived */
+  struct trial_result result;
+
+  if (!control_recv(ctl, &result, sizeof result)) {
+    printf("ERROR: The receiver did not report the trial.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  const int lossless = result.received == result.expected && result.corrupt == 0;
+
+  /* a lossless trial below the requested rate says nothing about that rate */
+  outcome.verdict       = !lossless ? TRIAL_LOSSY
+                        : outcome.sent_gbps < MIN_SENT_FRACTION * total_bps / 1e9 ? TRIAL_SENDER_SHORT
+                        : TRIAL_LOSSLESS;
+  outcome.received_gbps = result.duration_ns > 0 ? result.nr_bytes / GBPS / (result.duration_ns / 1e9) : 0.0;
+
+  printf("  %2d ports of %5lu bytes at %6.3f Gbit/s: sent %6.3f, received %6.3f Gbit/s, lost %lu of %lu packets, %lu corrupt%s\n",
+    nr_ports,
+    msg_size,
+    total_bps / 1e9,
+    outcome.sent_gbps,
+    outcome.received_gbps,
+    result.expected - result.received,
+    result.expected,
+    result.corrupt,
+    outcome.verdict == TRIAL_LOSSY ? " -> loss" : outcome.verdict == TRIAL_SENDER_SHORT ? " -> sender short" : "");
+
+  return outcome;
+}
+
+void sweep(const struct sweep_config *c) {
+  const int nr_points = c->nr_msg_sizes * c->nr_port_counts;
+  double capacity[nr_points], received[nr_points], sent[nr_points];
+  int sender_limited[nr_points];
+  int s, p;
+
+  printf("Connecting to eth-test-receive on TCP port %u...\n", c->control_port);
+  const int ctl = control_connect(c->host, c->control_port);
+
+  for (p = 0; p < c->nr_port_counts; p++) {
+    for (s = 0; s < c->nr_msg_sizes; s++) {
+      const int point = p * c->nr_msg_sizes + s;
+      const int nr_ports = c->port_counts[p];
+      const size_t msg_size = c->msg_sizes[s];
+
+      printf("Searching the capacity of %d ports of %lu bytes:\n", nr_ports, msg_size);
+
+      /* lo is the highest rate found lossless, hi the lowest rate found lossy or
+       * out of reach of the sender (or the maximum) */
+      double lo = 0.0, hi = c->max_bps, rate = hi;
+
+      capacity[point] = received[point] = sent[point] = 0.0;
+      sender_limited[point] = 0;
+
+      for (;;) {
+        const struct trial_outcome outcome = run_trial(c, ctl, nr_ports, msg_size, rate);
+
+        if (outcome.verdict == TRIAL_LOSSLESS) {
+          lo = rate;
+        } else {
+          hi = rate;
+        }
+
+        /* keep the highest rate that arrived in full: the requested rate if the sender
+         * kept up, and the rate it actually sent at if not */
+        const double arrived_bps = outcome.verdict == TRIAL_LOSSLESS ? rate : outcome.sent_gbps * 1e9;
+
+        if (outcome.verdict != TRIAL_LOSSY && arrived_bps > capacity[point]) {
+          capacity[point]       = arrived_bps;
+          received[point]       = outcome.received_gbps;
+          sent[point]           = outcome.sent_gbps;
+          sender_limited[point] = outcome.verdict == TRIAL_SENDER_SHORT;
+        }
+
+        if (hi - lo <= c->resolution_bps)
+          break;
+
+        rate = (lo + hi) / 2;
+      }
+    }
+  }
+
+  /* end the series */
+  const struct trial last = { 0, 0, 0, 0 };
+  control_send(ctl, &last, sizeof last);
+  close(ctl);
+
+  printf(" ----- Capacity curve -----\n");
+  printf("Resolution:   %.3f Gbit/s, trials of %d ms\n", c->resolution_bps / 1e9, c->trial_ms);
+  printf("Ports  Bytes/packet  Lossless rate  Sent          Received\n");
+  for (p = 0; p < c->nr_port_counts; p++) {
+    for (s = 0; s < c->nr_msg_sizes; s++) {
+      const int point = p * c->nr_msg_sizes + s;
+
+      printf("%5ld  %12ld  %6.3f Gbit/s   %6.3f Gbit/s  %6.3f Gbit/s%s\n",
+        c->port_counts[p],
+        c->msg_sizes[s],
+        capacity[point] / 1e9,
+        sent[point],
+        received[point],
+        capacity[point] == 0.0 ? " (none found)" : sender_limited[point] ? " (sender limited)" : "");
+    }
+  }
+}
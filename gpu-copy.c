@@ -1,54 +1,54 @@
-#include <cuda.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <omp.h>
 
 #include "common.h"
-
-/* report and bail if the exit code from a CUDA function ("result") is not succesful */
-void checkCuCall(const char *funcname, CUresult result) {
-  if (result != CUDA_SUCCESS) {
-    printf("Call %s failed with error code %d (see cuda.h)\n", funcname, result);
-    exit(EXIT_FAILURE);
-  }
-}
+#include "copy-engine.h"
 
 #define ITERATIONS 10
 
+/* Chunk sizes to try for bidirectional copies, in bytes. */
+#define MIN_CHUNK_SIZE (1UL * 1024 * 1024)
+#define MAX_CHUNK_SIZE (64UL * 1024 * 1024)
+
 struct report {
   double write_speed_gbps;
   double read_speed_gbps;
+  double bidir_speed_gbps;   /* both directions at the same time, with the best chunk size */
+  size_t best_chunk_size;
 };
 
-struct report test_device( int deviceNr ) {
+struct report test_device( const struct copy_backend *backend, int deviceNr, int nrStreams ) {
   struct report result;
 
-  CUdevice device;
+  void *dev;
   size_t globalMemSize;
 
-  CUcontext context;
-  size_t bufferSize;
+  size_t bufferSize, halfSize, chunkSize;
   void *hostMem;
-  CUdeviceptr devMem;
+  uint64_t devMem;
+  void *stream;
+  struct copy_engine engine;
 
   struct timer t;
   int i;
 
   /* initialise */
-  checkCuCall("cuDeviceGet",         cuDeviceGet(&device, deviceNr));
-  checkCuCall("cuDeviceTotalMem",    cuDeviceTotalMem(&globalMemSize, device));
+  dev = backend->open(deviceNr, &globalMemSize);
   printf("[device %d] Total memory size: %.2f GByte RAM\n", deviceNr, globalMemSize/GBYTE);
 
-  checkCuCall("cuCtxCreate",         cuCtxCreate(&context, 0, device));
-
   printf("[device %d] Allocating memory...\n", deviceNr);
 
   bufferSize = globalMemSize/1.1; /* allocate just about all device memory */
-  checkCuCall("cuMemAlloc",          cuMemAlloc(&devMem, bufferSize));
-  checkCuCall("cuMemHostAlloc",      cuMemHostAlloc(&hostMem, bufferSize, 0));
+  devMem  = backend->dev_alloc(dev, bufferSize);
+  hostMem = backend->host_alloc(dev, bufferSize);
   memset(hostMem, 1, bufferSize);
 
+  stream = backend->stream_create(dev);
+  copy_engine_init(&engine, backend, dev, nrStreams);
+
   printf("[device %d] Waiting for other threads...\n", deviceNr);
 
   /* GPU write test */
@@ -56,7 +56,8 @@ struct report test_device( int deviceNr ) {
   printf("[device %d] Writing %.2f GByte to GPU, %d times...\n", deviceNr, bufferSize/GBYTE, ITERATIONS);
   start(&t);
   for( i = 0; i < ITERATIONS; i++ ) {
-    checkCuCall("cuMemcpyHtoD",        cuMemcpyHtoD(devMem, hostMem, bufferSize));
+    backend->htod(stream, devMem, hostMem, bufferSize);
+    backend->stream_sync(stream);
   }
   stop(&t);
 
@@ -72,7 +73,8 @@ struct report test_device( int deviceNr ) {
   printf("[device %d] Reading %.2f GByte from GPU, %d times...\n", deviceNr, bufferSize/GBYTE, ITERATIONS);
   start(&t);
   for( i = 0; i < ITERATIONS; i++ ) {
-    checkCuCall("cuMemcpyDtoH",   cuMemcpyDtoH(hostMem, devMem, bufferSize));
+    backend->dtoh(stream, hostMem, devMem, bufferSize);
+    backend->stream_sync(stream);
   }
   stop(&t);
 
@@ -83,50 +85,124 @@ struct report test_device( int deviceNr ) {
     ITERATIONS,
     result.read_speed_gbps);
 
+  /* GPU bidirectional test: write the first half of the buffer while reading the second half */
+  halfSize = bufferSize / 2;
+  result.bidir_speed_gbps = 0.0;
+  result.best_chunk_size = 0;
+
+  for( chunkSize = MIN_CHUNK_SIZE; chunkSize <= MAX_CHUNK_SIZE; chunkSize *= 2 ) {
+#pragma omp barrier
+    const struct copy_result r = copy_engine_run(&engine, COPY_HTOD | COPY_DTOH,
+                                                 devMem, hostMem,
+                                                 (char*)hostMem + halfSize, devMem + halfSize,
+                                                 halfSize, chunkSize);
+
+    printf("[device %d] Writing and reading %.2f GByte in chunks of %lu MiB on %d streams each: %.2f + %.2f = %.2f Gbit/s\n",
+      deviceNr,
+      halfSize/GBYTE,
+      chunkSize / (1024 * 1024),
+      nrStreams,
+      r.htod_gbps,
+      r.dtoh_gbps,
+      r.total_gbps);
+
+    if (r.total_gbps > result.bidir_speed_gbps) {
+      result.bidir_speed_gbps = r.total_gbps;
+      result.best_chunk_size = chunkSize;
+    }
+  }
+
+  printf("[device %d] Best bidirectional speed: %.2f Gbit/s, with chunks of %lu MiB\n",
+    deviceNr,
+    result.bidir_speed_gbps,
+    result.best_chunk_size / (1024 * 1024));
+
   /* Teardown */
 #pragma omp barrier
   printf("[device %d] Cleaning up...\n", deviceNr);
 
-  checkCuCall("cuMemFree",           cuMemFree(devMem));
-  checkCuCall("cuMemFreeHost",       cuMemFreeHost(hostMem));
-  checkCuCall("cuCtxDestroy",        cuCtxDestroy(context));
+  copy_engine_destroy(&engine);
+  backend->stream_destroy(stream);
+  backend->dev_free(dev, devMem);
+  backend->host_free(dev, hostMem);
+  backend->close(dev);
 
   return result;
 }
 
-int main() {
+void usage(const char *progname) {
+  printf("Usage: %s [options]\n", progname);
+  printf("       %s -?\n", progname);
+  printf("\n");
+  printf("  -s      Number of streams per direction for bidirectional copies [4].\n");
+  printf("  -h      Show this help.\n");
+}
+
+int main(int argc, char **argv) {
+#ifdef NO_CUDA
+  const struct copy_backend *backend = &host_backend;
+#else
+  const struct copy_backend *backend = &cuda_backend;
+#endif
+  int nrStreams = 4;
   int nrDevices;
-  int deviceNr;
-  int i;
+  int opt, i;
+
+  /* parse command-line options */
+  while ((opt = getopt(argc, argv, "s:h")) != -1) {
+    switch (opt) {
+    case 's':
+      nrStreams = atoi(optarg);
+      if (nrStreams < 1 || nrStreams > MAX_COPY_STREAMS) {
+        printf("Number of streams must be between 1 and %d.\n", MAX_COPY_STREAMS);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'h':
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+
+    default: /* '?' */
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
 
-  /* initialise */
-  printf("Initialising GPU...\n");
+  if (optind < argc) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
 
-  checkCuCall("cuInit",              cuInit(0));
-  checkCuCall("cuDeviceGetCount",    cuDeviceGetCount(&nrDevices));
+  /* initialise */
+  printf("Initialising %s devices...\n", backend->name);
 
-  omp_set_num_threads(nrDevices);
+  nrDevices = backend->init();
 
   /* test all devices in parallel */
   struct report reports[nrDevices];
 
-#pragma omp parallel for num_threads(nrDevices)
-  for( deviceNr = 0; deviceNr < nrDevices; deviceNr++ ) {
-    reports[deviceNr] = test_device(deviceNr);
+#pragma omp parallel num_threads(nrDevices)
+  {
+    const int deviceNr = omp_get_thread_num();
+
+    reports[deviceNr] = test_device(backend, deviceNr, nrStreams);
   }
 
   /* calculate and show summary */
   printf(" ----- Test results -----\n");
-  struct report totals = { 0.0, 0.0 };
+  struct report totals = { 0.0, 0.0, 0.0, 0 };
   const int nr_reports = sizeof reports / sizeof reports[0];
   for ( i = 0; i < nr_reports; i++ ) {
     totals.write_speed_gbps += reports[i].write_speed_gbps; /* sum */
     totals.read_speed_gbps  += reports[i].read_speed_gbps; /* sum */
+    totals.bidir_speed_gbps += reports[i].bidir_speed_gbps; /* sum */
   }
 
-  printf("Test version:      %s\n", VERSION);
-  printf("Total write speed: %.2f Gbit/s\n", totals.write_speed_gbps);
-  printf("Total read speed:  %.2f Gbit/s\n", totals.read_speed_gbps);
+  printf("Test version:              %s\n", VERSION);
+  printf("Total write speed:         %.2f Gbit/s\n", totals.write_speed_gbps);
+  printf("Total read speed:          %.2f Gbit/s\n", totals.read_speed_gbps);
+  printf("Total bidirectional speed: %.2f Gbit/s\n", totals.bidir_speed_gbps);
 
   return EXIT_SUCCESS;
 }
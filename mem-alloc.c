@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <numa.h>
+#include <numaif.h>
+
+#include "common.h"
+#include "mem-alloc.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB   (21 << MAP_HUGE_SHIFT)
+#endif
+
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB   (30 << MAP_HUGE_SHIFT)
+#endif
+
+/* Size of a transparent huge page. */
+#define THP_SIZE       (2UL << 20)
+
+/* Number of pages to sample to determine the node of a buffer. */
+#define LOCATE_SAMPLES 64
+
+static size_t round_up(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+/* mmap() anonymous memory aligned to THP_SIZE, so it can be backed by transparent huge pages */
+static void *map_aligned(size_t size) {
+  char *ptr = mmap(NULL, size + THP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (ptr == MAP_FAILED)
+    checkSyscall("mmap()", -1);
+
+  /* trim to an aligned range */
+  char *aligned = (char *)round_up((uintptr_t)ptr, THP_SIZE);
+
+  if (aligned > ptr)
+    munmap(ptr, aligned - ptr);
+
+  munmap(aligned + size, ptr + THP_SIZE - aligned);
+
+  return aligned;
+}
+
+/* allocate a buffer on `node' (if placement != PLACE_DEFAULT) */
+static void alloc_on(struct buffer *buf, size_t size, placement_t placement, int node, pages_t pages, int value) {
+  memset(buf, 0, sizeof *buf);
+
+  buf->size      = size;
+  buf->placement = placement;
+  buf->pages     = pages;
+  buf->node      = placement != PLACE_DEFAULT ? node : -1;
+
+  if (placement == PLACE_DEFAULT && pages == PAGES_DEFAULT) {
+    /* plain malloc(), as used originally */
+    buf->ptr = malloc(size);
+
+    if (!buf->ptr) {
+      printf("ERROR: Could not allocate %lu bytes.\n", size);
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    void *ptr = MAP_FAILED;
+
+    if (pages == PAGES_2M || pages == PAGES_1G) {
+      buf->mapped_size = round_up(size, pages == PAGES_1G ? 1UL << 30 : 2UL << 20);
+
+      ptr = mmap(NULL, buf->mapped_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (pages == PAGES_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB), -1, 0);
+
+      if (ptr == MAP_FAILED) {
+        printf("WARNING: No %s huge pages available, using transparent huge pages instead.\n", pages_name(pages));
+        buf->pages = PAGES_THP;
+      }
+    }
+
+    if (ptr == MAP_FAILED) {
+      buf->mapped_size = round_up(size, THP_SIZE);
+      ptr = map_aligned(buf->mapped_size);
+
+      if (buf->pages == PAGES_THP)
+        (void)madvise(ptr, buf->mapped_size, MADV_HUGEPAGE);
+      else if (buf->pages == PAGES_4K)
+        (void)madvise(ptr, buf->mapped_size, MADV_NOHUGEPAGE);
+    }
+
+    /* overrides the memory binding of the thread for this range */
+    if (buf->node >= 0)
+      numa_tonode_memory(ptr, buf->mapped_size, buf->node);
+
+    buf->ptr = ptr;
+  }
+
+  /* fault in the memory */
+  memset(buf->ptr, value, size);
+
+  buffer_locate(buf);
+}
+
+void buffer_alloc(struct buffer *buf, size_t size, placement_t placement, pages_t pages, int value) {
+  const int local = numa_node_of_cpu(sched_getcpu());
+
+  alloc_on(buf, size, placement, placement == PLACE_REMOTE ? (local + 1) % nrNodes() : local, pages, value);
+}
+
+void buffer_alloc_node(struct buffer *buf, size_t size, int node, pages_t pages, int value) {
+  alloc_on(buf, size, PLACE_NODE, node, pages, value);
+}
+
+void buffer_free(struct buffer *buf) {
+  if (buf->mapped_size)
+    munmap(buf->ptr, buf->mapped_size);
+  else
+    free(buf->ptr);
+
+  buf->ptr = NULL;
+}
+
+/* Return the percentage of the mappings overlapping `buf' that is backed by huge pages. */
+static double huge_percentage(const struct buffer *buf) {
+  const uintptr_t begin = (uintptr_t)buf->ptr, end = begin + buf->size;
+  size_t total_kb = 0, huge_kb = 0, kb;
+  unsigned long vma_begin, vma_end;
+  int inside = 0;
+  char line[256];
+
+  if (buf->pages == PAGES_2M || buf->pages == PAGES_1G)
+    return 100.0;
+
+  FILE *f = fopen("/proc/self/smaps", "r");
+  if (!f)
+    return 0.0;
+
+  while (fgets(line, sizeof line, f)) {
+    if (sscanf(line, "%lx-%lx ", &vma_begin, &vma_end) == 2)
+      inside = vma_begin < end && vma_end > begin;
+    else if (inside && sscanf(line, "Size: %lu kB", &kb) == 1)
+      total_kb += kb;
+    else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+      huge_kb += kb;
+  }
+
+  fclose(f);
+
+  return total_kb ? 100.0 * huge_kb / total_kb : 0.0;
+}
+
+void buffer_locate(struct buffer *buf) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const int nr_samples = buf->size / page_size < LOCATE_SAMPLES ? buf->size / page_size + 1 : LOCATE_SAMPLES;
+  void *pages[LOCATE_SAMPLES];
+  int status[LOCATE_SAMPLES];
+  int counts[nrNodes()];
+  int i, best = -1;
+
+  for (i = 0; i < nr_samples; i++) {
+    const uintptr_t addr = (uintptr_t)buf->ptr + buf->size / nr_samples * i;
+
+    pages[i] = (void *)(addr / page_size * page_size);
+  }
+
+  buf->actual_node = -1;
+  buf->node_perc   = 0.0;
+
+  /* without target nodes, move_pages() only reports where the pages are */
+  if (numa_move_pages(0, nr_samples, pages, NULL, status, 0) == 0) {
+    memset(counts, 0, sizeof counts);
+
+    for (i = 0; i < nr_samples; i++) {
+      if (status[i] >= 0 && status[i] < nrNodes())
+        counts[status[i]]++;
+    }
+
+    for (i = 0; i < nrNodes(); i++) {
+      if (best < 0 || counts[i] > counts[best])
+        best = i;
+    }
+
+    if (counts[best] > 0) {
+      buf->actual_node = best;
+      buf->node_perc   = 100.0 * counts[best] / nr_samples;
+    }
+  }
+
+  buf->huge_perc = huge_percentage(buf);
+}
+
+const char *placement_name(placement_t placement) {
+  switch (placement) {
+    case PLACE_DEFAULT: return "default";
+    case PLACE_LOCAL:   return "local";
+    case PLACE_REMOTE:  return "remote";
+    case PLACE_NODE:    return "node";
+  }
+
+  return "???";
+}
+
+const char *pages_name(pages_t pages) {
+  switch (pages) {
+    case PAGES_DEFAULT: return "default";
+    case PAGES_4K:      return "4k";
+    case PAGES_THP:     return "thp";
+    case PAGES_2M:      return "2m";
+    case PAGES_1G:      return "1g";
+  }
+
+  return "???";
+}
+
+int parse_placement(const char *name, placement_t *placement) {
+  placement_t p;
+
+  for (p = PLACE_DEFAULT; p <= PLACE_REMOTE; p++) {
+    if (!strcmp(name, placement_name(p))) {
+      *placement = p;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+int parse_pages(const char *name, pages_t *pages) {
+  pages_t p;
+
+  for (p = PAGES_DEFAULT; p <= PAGES_1G; p++) {
+    if (!strcmp(name, pages_name(p))) {
+      *pages = p;
+      return 0;
+    }
+  }
+
+  return -1;
+}
@@ -0,0 +1,60 @@
+#ifndef __MEM_ALLOC__
+#define __MEM_ALLOC__
+
+#include <stddef.h>
+
+/* Where to place a buffer. */
+typedef enum {
+  PLACE_DEFAULT, /* malloc(), following the memory policy of the thread */
+  PLACE_LOCAL,   /* on the NUMA node of the allocating thread */
+  PLACE_REMOTE,  /* on the next NUMA node, to measure the cost of remote memory */
+  PLACE_NODE     /* on a given NUMA node, see buffer_alloc_node() */
+} placement_t;
+
+/* Which pages to back a buffer with. */
+typedef enum {
+  PAGES_DEFAULT, /* whatever the system provides */
+  PAGES_4K,      /* normal pages, transparent huge pages disabled */
+  PAGES_THP,     /* transparent huge pages */
+  PAGES_2M,      /* explicit 2 MiB huge pages (MAP_HUGETLB) */
+  PAGES_1G       /* explicit 1 GiB huge pages (MAP_HUGETLB) */
+} pages_t;
+
+/* A buffer, and where its memory actually landed. */
+struct buffer {
+  void *ptr;
+  size_t size;
+  size_t mapped_size;  /* 0 if allocated with malloc() */
+
+  placement_t placement;
+  pages_t pages;       /* pages obtained, which can differ from the requested ones */
+  int node;            /* node requested, or -1 */
+
+  int actual_node;     /* node holding most of the buffer, or -1 if unknown */
+  double node_perc;    /* percentage of the buffer on actual_node */
+  double huge_perc;    /* percentage of the buffer backed by huge pages */
+};
+
+/* Allocate `size' bytes, placed and backed as requested, and fill them with `value'.
+ *
+ * If explicit huge pages are not available, transparent huge pages are used
+ * instead, which is reflected in buf->pages.
+ */
+void buffer_alloc(struct buffer *buf, size_t size, placement_t placement, pages_t pages, int value);
+
+/* Allocate `size' bytes on NUMA node `node', backed as requested, and fill them with `value'. */
+void buffer_alloc_node(struct buffer *buf, size_t size, int node, pages_t pages, int value);
+
+void buffer_free(struct buffer *buf);
+
+/* Determine where the (touched) memory of `buf' resides. */
+void buffer_locate(struct buffer *buf);
+
+const char *placement_name(placement_t placement);
+const char *pages_name(pages_t pages);
+
+/* Parse a name into a placement or pages. Return 0 on success, -1 if the name is unknown. */
+int parse_placement(const char *name, placement_t *placement);
+int parse_pages(const char *name, pages_t *pages);
+
+#endif
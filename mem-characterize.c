@@ -0,0 +1,401 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <numa.h>
+#include <omp.h>
+
+#include "common.h"
+#include "mem-alloc.h"
+#include "mem-config.h"
+#include "mem-characterize.h"
+
+/* Size of a cache line, the unit of the pointer chase. */
+#define CACHE_LINE 64
+
+/* Number of loads between checks of the time in a pointer chase. */
+#define CHASE_CHUNK 65536
+
+/* Bytes to stream between checks of the time, so small working sets do not
+ * mostly measure the clock. */
+#define STREAM_CHUNK (1024UL * 1024)
+
+/* Where the kernel describes the caches of every CPU. */
+#define CPU_SYSFS "/sys/devices/system/cpu"
+
+/* Maximum number of CPUs per NUMA node to use. */
+#define MAX_NODE_CPUS 1024
+
+/* Local and remote latencies closer than this fraction suggest interleaved memory. */
+#define INTERLEAVE_MARGIN 0.05
+
+/* keeps the results of the kernels and the chase live */
+static volatile uint64_t checksum;
+static void * volatile chase_end;
+
+size_t cache_size(int level) {
+  long size = -1;
+
+  switch (level) {
+    case 1: size = sysconf(_SC_LEVEL1_DCACHE_SIZE); break;
+    case 2: size = sysconf(_SC_LEVEL2_CACHE_SIZE);  break;
+    case 3: size = sysconf(_SC_LEVEL3_CACHE_SIZE);  break;
+  }
+
+  return size > 0 ? size : 0;
+}
+
+/* read the first line of `path' into `buf'. Return 0 on success, -1 otherwise. */
+static int read_line(const char *path, char *buf, size_t len) {
+  FILE *f;
+
+  if (!(f = fopen(path, "r")))
+    return -1;
+
+  if (!fgets(buf, len, f)) {
+    fclose(f);
+    return -1;
+  }
+
+  fclose(f);
+  buf[strcspn(buf, "\n")] = 0;
+  return 0;
+}
+
+size_t total_cache_size(int level) {
+  const long nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  size_t total = 0;
+  long cpu;
+  int index;
+
+  for (cpu = 0; cpu < nr_cpus; cpu++) {
+    for (index = 0; ; index++) {
+      char path[256], buf[256];
+      unsigned long size;
+      char unit = 0;
+
+      snprintf(path, sizeof path, "%s/cpu%ld/cache/index%d/level", CPU_SYSFS, cpu, index);
+      if (read_line(path, buf, sizeof buf) < 0)
+        break; /* no more caches, or an offline CPU */
+
+      if (atoi(buf) != level)
+        continue;
+
+      snprintf(path, sizeof path, "%s/cpu%ld/cache/index%d/type", CPU_SYSFS, cpu, index);
+      if (read_line(path, buf, sizeof buf) < 0 || !strcmp(buf, "Instruction"))
+        continue;
+
+      /* count each cache once, from the first CPU that shares it */
+      snprintf(path, sizeof path, "%s/cpu%ld/cache/index%d/shared_cpu_list", CPU_SYSFS, cpu, index);
+      if (read_line(path, buf, sizeof buf) < 0 || atol(buf) != cpu)
+        continue;
+
+      snprintf(path, sizeof path, "%s/cpu%ld/cache/index%d/size", CPU_SYSFS, cpu, index);
+      if (read_line(path, buf, sizeof buf) < 0 || sscanf(buf, "%lu%c", &size, &unit) < 1)
+        continue;
+
+      total += unit == 'K' ? size << 10 : unit == 'M' ? size << 20 : size;
+    }
+  }
+
+  return total > 0 ? total : cache_size(level);
+}
+
+/* pin the calling thread to `cpu' */
+static void pin_to_cpu(int cpu) {
+  cpu_set_t cpuset;
+
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  checkSyscall("sched_setaffinity()", sched_setaffinity(0, sizeof cpuset, &cpuset));
+}
+
+/* link all cache lines of `buf' into one cycle in random order, so every load
+ * depends on the previous one and defeats the prefetchers, and return its start */
+static void **build_chase(void *buf, size_t size) {
+  const size_t nr_lines = size / CACHE_LINE;
+  size_t *order = malloc(nr_lines * sizeof *order);
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  size_t i;
+
+  if (!order) {
+    printf("ERROR: Could not allocate %lu bytes.\n", nr_lines * sizeof *order);
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < nr_lines; i++)
+    order[i] = i;
+
+  /* Fisher-Yates shuffle, with xorshift64 */
+  for (i = nr_lines - 1; i > 0; i--) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    const size_t j = state % (i + 1);
+    const size_t tmp = order[i];
+
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  for (i = 0; i < nr_lines; i++)
+    *(void **)((char *)buf + order[i] * CACHE_LINE) = (char *)buf + order[(i + 1) % nr_lines] * CACHE_LINE;
+
+  void **start = (void **)((char *)buf + order[0] * CACHE_LINE);
+
+  free(order);
+
+  return start;
+}
+
+/* follow the chase from `start' for at least MEASURE_SECONDS, and return the time per load, in ns */
+static double chase_latency(void **start, size_t size) {
+  void **p = start;
+  size_t i, nr_loads = 0;
+
+  /* warm up: one round through the working set, bounded for large ones */
+  const size_t warmup = size / CACHE_LINE < 16 * CHASE_CHUNK ? size / CACHE_LINE : 16 * CHASE_CHUNK;
+
+  for (i = 0; i < warmup; i++)
+    p = (void **)*p;
+
+  const uint64_t begin = now_ns();
+  uint64_t end;
+
+  do {
+    for (i = 0; i < CHASE_CHUNK; i++)
+      p = (void **)*p;
+
+    nr_loads += CHASE_CHUNK;
+    end = now_ns();
+  } while (end - begin < MEASURE_SECONDS * 1e9);
+
+  chase_end = p;
+
+  return (double)(end - begin) / nr_loads;
+}
+
+/* repeat `operation' on `size' bytes for at least MEASURE_SECONDS from `begin', and return the number of bytes processed */
+static size_t stream(const struct kernels *k, transfer_t operation, void *dst, const void *src, size_t size, uint64_t begin) {
+  const size_t nr_calls = size < STREAM_CHUNK ? STREAM_CHUNK / size : 1;
+  size_t nr_bytes = 0, i;
+  uint64_t sum = 0;
+
+  do {
+    for (i = 0; i < nr_calls; i++) {
+      switch (operation) {
+        case READ:
+          sum += k->read(src, size);
+          break;
+
+        case WRITE:
+          k->write(dst, 42, size);
+          break;
+
+        case COPY:
+        default:
+          k->copy(dst, src, size);
+          break;
+      }
+    }
+
+    nr_bytes += nr_calls * size;
+  } while (now_ns() - begin < MEASURE_SECONDS * 1e9);
+
+  /* once per thread */
+  __atomic_add_fetch(&checksum, sum, __ATOMIC_RELAXED);
+
+  return nr_bytes;
+}
+
+/* print a matrix of nr_nodes x nr_nodes values, CPU nodes as rows */
+static void print_matrix(const char *title, const double *values, int nr_nodes) {
+  int cpu_node, mem_node;
+
+  printf("%s, CPU node (rows) x memory node (columns):\n", title);
+
+  printf("        ");
+  for (mem_node = 0; mem_node < nr_nodes; mem_node++)
+    printf("  node %-3d", mem_node);
+  printf("\n");
+
+  for (cpu_node = 0; cpu_node < nr_nodes; cpu_node++) {
+    printf("node %-3d", cpu_node);
+    for (mem_node = 0; mem_node < nr_nodes; mem_node++)
+      printf("  %8.1f", values[cpu_node * nr_nodes + mem_node]);
+    printf("\n");
+  }
+}
+
+void numa_matrix(const struct characterization *c) {
+  const int nr_nodes = nrNodes();
+  const transfer_t operations[] = { READ, WRITE, COPY };
+  const int nr_operations = sizeof operations / sizeof operations[0];
+  double speed[nr_operations][nr_nodes * nr_nodes];
+  double latency[nr_nodes * nr_nodes];
+  int landed[nr_nodes];
+  double landed_perc[nr_nodes];
+  int cpu_node, mem_node, op;
+
+  cpu_set_t original;
+  checkSyscall("sched_getaffinity()", sched_getaffinity(0, sizeof original, &original));
+
+  printf("Measuring %d x %d NUMA node pairs, %lu MiB per buffer...\n", nr_nodes, nr_nodes, c->max_working_set >> 20);
+
+  for (mem_node = 0; mem_node < nr_nodes; mem_node++) {
+    /* one chase through memory of this node, followed from every node */
+    struct buffer chase;
+
+    buffer_alloc_node(&chase, c->max_working_set, mem_node, c->pages, 0);
+    void **start = build_chase(chase.ptr, chase.size);
+
+    landed[mem_node]      = chase.actual_node;
+    landed_perc[mem_node] = chase.node_perc;
+
+    for (cpu_node = 0; cpu_node < nr_nodes; cpu_node++) {
+      int cpus[MAX_NODE_CPUS];
+      const int nr_cpus = nodeCpus(cpu_node, cpus, MAX_NODE_CPUS);
+      const int pair = cpu_node * nr_nodes + mem_node;
+
+      if (nr_cpus == 0) {
+        /* a memory-only node */
+        for (op = 0; op < nr_operations; op++)
+          speed[op][pair] = 0.0;
+        latency[pair] = 0.0;
+        continue;
+      }
+
+      pin_to_cpu(cpus[0]);
+      latency[pair] = chase_latency(start, chase.size);
+
+      /* stream with the CPUs of cpu_node, each through its own part of the memory */
+      const int nr_threads = c->threads_per_node > 0 ? c->threads_per_node : nr_cpus;
+      const size_t slice = (c->max_working_set / nr_threads + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+      size_t nr_bytes[nr_operations];
+      uint64_t begin[nr_operations], end[nr_operations];
+
+      memset(nr_bytes, 0, sizeof nr_bytes);
+
+#pragma omp parallel num_threads(nr_threads)
+      {
+        struct buffer src, dst;
+        int o;
+
+        pin_to_cpu(cpus[omp_get_thread_num() % nr_cpus]);
+
+        buffer_alloc_node(&src, slice, mem_node, c->pages, 1);
+        buffer_alloc_node(&dst, slice, mem_node, c->pages, 2);
+
+        for (o = 0; o < nr_operations; o++) {
+          /* start together */
+#pragma omp barrier
+#pragma omp single
+          begin[o] = now_ns();
+
+          const size_t bytes = stream(c->k, operations[o], dst.ptr, src.ptr, slice, begin[o]);
+
+#pragma omp atomic
+          nr_bytes[o] += bytes;
+
+          /* end when the slowest is done */
+#pragma omp barrier
+#pragma omp single
+          end[o] = now_ns();
+        }
+
+        buffer_free(&dst);
+        buffer_free(&src);
+      }
+
+      for (op = 0; op < nr_operations; op++)
+        speed[op][pair] = nr_bytes[op] / GBPS / ((end[op] - begin[op]) / 1e9);
+
+      printf("  CPU node %d, memory node %d: read %.1f, write %.1f, copy %.1f Gbit/s with %d threads, latency %.1f ns\n",
+        cpu_node, mem_node, speed[0][pair], speed[1][pair], speed[2][pair], nr_threads, latency[pair]);
+    }
+
+    buffer_free(&chase);
+  }
+
+  checkSyscall("sched_setaffinity()", sched_setaffinity(0, sizeof original, &original));
+
+  printf(" ----- NUMA matrix -----\n");
+  print_matrix("Read speed (Gbit/s)", speed[0], nr_nodes);
+  print_matrix("Write speed (Gbit/s)", speed[1], nr_nodes);
+  print_matrix("Copy speed (Gbit/s)", speed[2], nr_nodes);
+  print_matrix("Load latency (ns)", latency, nr_nodes);
+
+  /* point out signs of a misconfigured machine */
+  for (mem_node = 0; mem_node < nr_nodes; mem_node++) {
+    if (landed[mem_node] >= 0 && (landed[mem_node] != mem_node || landed_perc[mem_node] < 90.0))
+      printf("WARNING: Memory requested on node %d landed on node %d (%.0f%%). Check the NUMA settings in the BIOS.\n",
+        mem_node, landed[mem_node], landed_perc[mem_node]);
+  }
+
+  for (cpu_node = 0; cpu_node < nr_nodes; cpu_node++) {
+    const double local = latency[cpu_node * nr_nodes + cpu_node];
+
+    for (mem_node = 0; mem_node < nr_nodes; mem_node++) {
+      const double remote = latency[cpu_node * nr_nodes + mem_node];
+
+      if (mem_node != cpu_node && local > 0.0 && remote > 0.0 && remote < local * (1.0 + INTERLEAVE_MARGIN))
+        printf("WARNING: Node %d reaches node %d as fast as its own memory (%.1f vs %.1f ns). Is memory interleaved across nodes?\n",
+          cpu_node, mem_node, remote, local);
+    }
+  }
+}
+
+void cache_sweep(const struct characterization *c) {
+  const size_t l1 = cache_size(1), l2 = cache_size(2), l3 = cache_size(3);
+  int cpus[MAX_NODE_CPUS];
+  size_t size;
+
+  cpu_set_t original;
+  checkSyscall("sched_getaffinity()", sched_getaffinity(0, sizeof original, &original));
+
+  /* on the first CPU of node 0, with local memory */
+  if (nodeCpus(0, cpus, MAX_NODE_CPUS) == 0 && nodeCpus(-1, cpus, MAX_NODE_CPUS) == 0) {
+    printf("ERROR: No CPU to run the cache sweep on.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pin_to_cpu(cpus[0]);
+  const int node = numa_node_of_cpu(cpus[0]);
+
+  printf(" ----- Cache sweep -----\n");
+  printf("Caches:       L1d %lu KiB, L2 %lu KiB, L3 %lu KiB (0 = unknown)\n", l1 >> 10, l2 >> 10, l3 >> 10);
+  printf("CPU %d, memory on node %d, %s kernel\n", cpus[0], node, c->k->name);
+  printf("Working set    Latency       Read speed      Level\n");
+
+  /* two steps per power of two: 2^n and 1.5 * 2^n */
+  for (size = MIN_WORKING_SET; size <= c->max_working_set; size = size % 3 == 0 ? size / 3 * 4 : size / 2 * 3) {
+    struct buffer buf;
+
+    buffer_alloc_node(&buf, size, node, c->pages, 1);
+
+    /* read speed first, as the chase overwrites the data */
+    const uint64_t begin = now_ns();
+    const size_t nr_bytes = stream(c->k, READ, NULL, buf.ptr, size, begin);
+    const double read_gbps = nr_bytes / GBPS / ((now_ns() - begin) / 1e9);
+
+    void **start = build_chase(buf.ptr, size);
+    const double latency = chase_latency(start, size);
+
+    printf("%8lu KiB  %7.1f ns  %9.1f Gbit/s  %s\n",
+      size >> 10,
+      latency,
+      read_gbps,
+      l1 && size <= l1 ? "L1" :
+      l2 && size <= l2 ? "L2" :
+      l3 && size <= l3 ? "L3" :
+      l3 ? "DRAM" : "?");
+
+    buffer_free(&buf);
+  }
+
+  checkSyscall("sched_setaffinity()", sched_setaffinity(0, sizeof original, &original));
+}
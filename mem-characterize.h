@@ -0,0 +1,39 @@
+#ifndef __MEM_CHARACTERIZE__
+#define __MEM_CHARACTERIZE__
+
+#include <stddef.h>
+
+#include "mem-alloc.h"
+#include "mem-kernels.h"
+
+/* Minimum time to repeat each measurement for, in seconds. */
+#define MEASURE_SECONDS 0.1
+
+/* Smallest working set of the cache sweep, in bytes. */
+#define MIN_WORKING_SET (4UL * 1024)
+
+/* Settings of a characterization of the memory system. */
+struct characterization {
+  const struct kernels *k;
+  pages_t pages;
+  int threads_per_node;   /* streaming threads per CPU node, or 0 for all CPUs of the node */
+  size_t max_working_set; /* bytes per node pair for the matrix, and largest working set of the sweep */
+};
+
+/* Return the size of the data cache at `level' (1-3) of this CPU in bytes, or 0 if unknown. */
+size_t cache_size(int level);
+
+/* Return the size of all data caches at `level' (1-3) of all CPUs together in bytes,
+ * counting shared caches once. This exceeds cache_size(level) if, f.e., every core
+ * complex has its own L3. Falls back to cache_size(level). */
+size_t total_cache_size(int level);
+
+/* Measure the read, write and copy speed of the CPUs of every node to the memory of
+ * every node, and the load latency of one of these CPUs, and print them as matrices. */
+void numa_matrix(const struct characterization *c);
+
+/* Measure the load latency and read speed of one CPU for working sets from MIN_WORKING_SET
+ * up to c->max_working_set, and print them as a curve. */
+void cache_sweep(const struct characterization *c);
+
+#endif
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem-config.h"
+
+/* Maximum length of a line in a pipeline file. */
+#define MAX_LINE      1024
+
+static const char *whitespace = " \t\r\n";
+
+/* The pipeline of mem-test.conf, for when that file is not around. */
+static const char default_pipeline[] =
+  "stations       18\n"
+  "packets        1048576\n"
+  "packet_size    9000\n"
+  "transpose_dims 4,480\n"
+  "write      block=128   rate=3.0                 : station input (NIC -> DRAM)\n"
+  "copy       block=128   rate=3.0                 : station input (kernel -> user)\n"
+  "transpose  block=128   rate=3.0                 : station input (user -> IB staging)\n"
+  "copy       block=1024  rate=3.0                 : station input (IB exchange)\n"
+  "transpose  block=1024  rate=3.0                 : station input (GPU staging)\n"
+  "read       block=1024  rate=3.0                 : station input (DRAM -> GPU)\n"
+  "write      block=1024  rate=3.0  reduction=2    : processing output (GPU -> DRAM)\n"
+  "copy       block=1024  rate=3.0  reduction=2    : processing output (BF staging)\n"
+  "copy       block=1024  rate=3.0  reduction=2    : processing output (user -> kernel)\n"
+  "read       block=1024  rate=3.0  reduction=2    : processing output (DRAM -> NIC)\n";
+
+/* Report a syntax error in a pipeline file, and bail. */
+static void syntax_error(const char *filename, int line, const char *msg, const char *token) {
+  printf("%s:%d: %s: %s\n", filename, line, msg, token);
+  exit(EXIT_FAILURE);
+}
+
+static int parse_transfer(const char *name, transfer_t *operation) {
+  transfer_t t;
+
+  for (t = READ; t <= TRANSPOSE; t++) {
+    if (!strcmp(name, transfer_name(t))) {
+      *operation = t;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/* Parse a size_t of at least 1. Return 0 on success, -1 otherwise. */
+static int parse_count(const char *str, size_t *value) {
+  char *end;
+  const unsigned long long v = strtoull(str, &end, 10);
+
+  if (end == str || *end || v < 1)
+    return -1;
+
+  *value = v;
+  return 0;
+}
+
+/* Parse a positive double. Return 0 on success, -1 otherwise. */
+static int parse_positive(const char *str, double *value) {
+  char *end;
+  const double v = strtod(str, &end);
+
+  if (end == str || *end || !(v > 0.0))
+    return -1;
+
+  *value = v;
+  return 0;
+}
+
+/* Parse the key=value settings of a stage. */
+static void parse_stage(const char *filename, int line, char *settings, struct stage *s) {
+  char *token;
+
+  for (token = strtok(settings, whitespace); token; token = strtok(NULL, whitespace)) {
+    char *value = strchr(token, '=');
+
+    if (!value)
+      syntax_error(filename, line, "Expected key=value", token);
+
+    *value++ = 0;
+
+    if (!strcmp(token, "block")) {
+      if (parse_count(value, &s->block_packets) < 0)
+        syntax_error(filename, line, "Invalid block size", value);
+    } else if (!strcmp(token, "rate")) {
+      if (parse_positive(value, &s->gbits_per_sec) < 0)
+        syntax_error(filename, line, "Invalid rate", value);
+    } else if (!strcmp(token, "reduction")) {
+      if (parse_positive(value, &s->reduction) < 0)
+        syntax_error(filename, line, "Invalid reduction factor", value);
+    } else if (!strcmp(token, "placement")) {
+      if (parse_placement(value, &s->placement) < 0)
+        syntax_error(filename, line, "Unknown placement", value);
+    } else if (!strcmp(token, "pages")) {
+      if (parse_pages(value, &s->pages) < 0)
+        syntax_error(filename, line, "Unknown pages", value);
+    } else if (!strcmp(token, "kernel")) {
+      if (parse_kernel(value, &s->kernel) < 0)
+        syntax_error(filename, line, "Unknown kernel", value);
+    } else {
+      syntax_error(filename, line, "Unknown stage setting", token);
+    }
+  }
+}
+
+/* Parse a pipeline from `f', which is called `filename' in errors. */
+static void parse_pipeline(FILE *f, const char *filename, struct pipeline *p) {
+  char buf[MAX_LINE];
+  int line = 0, s;
+
+  memset(p, 0, sizeof *p);
+
+  /* defaults */
+  p->nr_stations = 18;
+  p->nr_packets  = 1024UL * 1024;
+  p->packet_size = 9000;
+  p->transpose_dims.stations = 4;
+  p->transpose_dims.subbands = 480;
+
+  while (fgets(buf, sizeof buf, f)) {
+    char *comment = strchr(buf, '#');
+    char *desc = strchr(buf, ':');
+    char *key, *value;
+
+    line++;
+
+    if (comment)
+      *comment = 0;
+
+    /* split off the description of a stage */
+    if (desc && (!comment || desc < comment))
+      *desc++ = 0;
+    else
+      desc = NULL;
+
+    if (!(key = strtok(buf, whitespace)))
+      continue; /* empty line */
+
+    if (!strcmp(key, "stations") || !strcmp(key, "packets") || !strcmp(key, "packet_size") || !strcmp(key, "transpose_dims")) {
+      size_t count;
+
+      if (!(value = strtok(NULL, whitespace)) || strtok(NULL, whitespace))
+        syntax_error(filename, line, "Expected a single value for", key);
+
+      if (!strcmp(key, "transpose_dims")) {
+        if (sscanf(value, "%lu,%lu", &p->transpose_dims.stations, &p->transpose_dims.subbands) != 2
+         || p->transpose_dims.stations < 1 || p->transpose_dims.subbands < 1)
+          syntax_error(filename, line, "Expected stations,subbands", value);
+      } else if (parse_count(value, &count) < 0) {
+        syntax_error(filename, line, "Invalid value", value);
+      } else if (!strcmp(key, "stations")) {
+        p->nr_stations = count;
+      } else if (!strcmp(key, "packets")) {
+        p->nr_packets = count;
+      } else {
+        p->packet_size = count;
+      }
+    } else {
+      struct stage *stage = &p->stages[p->nr_stages];
+
+      if (p->nr_stages == MAX_STAGES)
+        syntax_error(filename, line, "Too many stages", key);
+
+      memset(stage, 0, sizeof *stage);
+      stage->reduction = 1.0;
+      stage->placement = PLACE_DEFAULT;
+      stage->pages     = PAGES_DEFAULT;
+      stage->kernel    = KERNEL_AUTO;
+
+      if (parse_transfer(key, &stage->operation) < 0)
+        syntax_error(filename, line, "Unknown setting or operation", key);
+
+      if ((value = strtok(NULL, "")))
+        parse_stage(filename, line, value, stage);
+
+      if (!stage->block_packets || stage->gbits_per_sec == 0.0)
+        syntax_error(filename, line, "Stage needs a block and a rate", key);
+
+      /* trim the description */
+      if (desc) {
+        desc += strspn(desc, whitespace);
+
+        while (*desc && strchr(whitespace, desc[strlen(desc) - 1]))
+          desc[strlen(desc) - 1] = 0;
+      }
+
+      snprintf(stage->desc, sizeof stage->desc, "%s", desc && *desc ? desc : transfer_name(stage->operation));
+
+      p->nr_stages++;
+    }
+  }
+
+  fclose(f);
+
+  if (p->nr_stages == 0) {
+    printf("ERROR: Pipeline file %s does not define any stages.\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  /* derive the sizes, which depend on the global settings */
+  for (s = 0; s < p->nr_stages; s++) {
+    struct stage *stage = &p->stages[s];
+
+    stage->nr_bytes       = p->nr_packets * p->packet_size / stage->reduction;
+    stage->block_size     = stage->block_packets * p->packet_size;
+    stage->gbits_per_sec /= stage->reduction;
+  }
+}
+
+void load_pipeline(const char *filename, struct pipeline *p) {
+  FILE *f = fopen(filename, "r");
+  if (!f) {
+    printf("ERROR: Could not open pipeline file %s.\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  parse_pipeline(f, filename, p);
+}
+
+void load_default_pipeline(struct pipeline *p) {
+  FILE *f = fmemopen((void *)default_pipeline, sizeof default_pipeline - 1, "r");
+  if (!f) {
+    printf("ERROR: Could not read the built-in pipeline.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  parse_pipeline(f, DEFAULT_PIPELINE_NAME, p);
+}
+
+const char *transfer_name(transfer_t operation) {
+  switch (operation) {
+    case READ:      return "read";
+    case WRITE:     return "write";
+    case COPY:      return "copy";
+    case TRANSPOSE: return "transpose";
+  }
+
+  return "???";
+}
@@ -0,0 +1,60 @@
+#ifndef __MEM_CONFIG__
+#define __MEM_CONFIG__
+
+#include <stddef.h>
+
+#include "mem-alloc.h"
+#include "mem-kernels.h"
+
+typedef enum { READ, WRITE, COPY, TRANSPOSE } transfer_t;
+
+/* Maximum number of stages in a pipeline. */
+#define MAX_STAGES    32
+
+/* Maximum length of a stage description. */
+#define MAX_DESC      64
+
+/* A step in the pipeline, run concurrently for every station. */
+struct stage {
+  transfer_t operation;
+  char desc[MAX_DESC];
+
+  size_t block_packets; /* packets per operation */
+  double reduction;     /* factor by which the data volume is reduced */
+
+  size_t nr_bytes;      /* bytes to process per station */
+  size_t block_size;    /* bytes per operation */
+  double gbits_per_sec; /* rate per station */
+
+  placement_t placement;
+  pages_t pages;
+  kernel_t kernel;
+};
+
+/* The pipeline to emulate. */
+struct pipeline {
+  int nr_stations;
+  size_t nr_packets;    /* per station */
+  size_t packet_size;   /* in bytes */
+  struct transpose_dims transpose_dims;
+
+  int nr_stages;
+  struct stage stages[MAX_STAGES];
+};
+
+/* File to load the pipeline from if none is given. */
+#define DEFAULT_PIPELINE_FILE "mem-test.conf"
+
+/* Name of the built-in pipeline, which equals the shipped DEFAULT_PIPELINE_FILE. */
+#define DEFAULT_PIPELINE_NAME "built-in pipeline"
+
+/* Load a pipeline from `filename'. Exits with an error if the file cannot be
+ * opened or is invalid. */
+void load_pipeline(const char *filename, struct pipeline *p);
+
+/* Load the built-in pipeline. */
+void load_default_pipeline(struct pipeline *p);
+
+const char *transfer_name(transfer_t operation);
+
+#endif
@@ -0,0 +1,482 @@
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "mem-kernels.h"
+
+/* Number of bytes from `p' up to the next multiple of `align', at most `size'. */
+static size_t head_bytes(const void *p, size_t align, size_t size) {
+  const size_t head = (align - (uintptr_t)p % align) % align;
+
+  return head < size ? head : size;
+}
+
+/* Sum the bytes in a range too small for a vector. */
+static uint64_t read_bytes(const uint8_t *p, size_t size) {
+  uint64_t sum = 0;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    sum += p[i];
+
+  return sum;
+}
+
+/* Samples are transposed in tiles of this many times x subbands, which fit in L1 together. */
+#define TRANSPOSE_TILE 32
+
+/* Transpose a rows x cols matrix of samples: dst[c][r] = src[r][c]. */
+typedef void (*tile_fn)(uint64_t *dst, size_t dst_stride, const uint64_t *src, size_t src_stride, size_t rows, size_t cols);
+
+static void tile_scalar(uint64_t *dst, size_t dst_stride, const uint64_t *src, size_t src_stride, size_t rows, size_t cols) {
+  size_t r, c;
+
+  for (c = 0; c < cols; c++)
+    for (r = 0; r < rows; r++)
+      dst[c * dst_stride + r] = src[r * src_stride + c];
+}
+
+/* For each station, transpose its [time][subband] matrix tile by tile. */
+static void transpose_blocked(void *dst, const void *src, const struct transpose_dims *dims, tile_fn tile) {
+  const size_t src_stride = dims->stations * dims->subbands; /* between times */
+  const size_t dst_stride = dims->stations * dims->times;    /* between subbands */
+  size_t st, t, sb;
+
+  for (st = 0; st < dims->stations; st++) {
+    for (t = 0; t < dims->times; t += TRANSPOSE_TILE) {
+      const size_t rows = dims->times - t < TRANSPOSE_TILE ? dims->times - t : TRANSPOSE_TILE;
+
+      for (sb = 0; sb < dims->subbands; sb += TRANSPOSE_TILE) {
+        const size_t cols = dims->subbands - sb < TRANSPOSE_TILE ? dims->subbands - sb : TRANSPOSE_TILE;
+
+        tile((uint64_t *)dst + (sb * dims->stations + st) * dims->times + t, dst_stride,
+             (const uint64_t *)src + (t * dims->stations + st) * dims->subbands + sb, src_stride,
+             rows, cols);
+      }
+    }
+  }
+}
+
+/* ----- libc: the original behaviour */
+
+static uint64_t read_libc(const void *src, size_t size) {
+  const int *p = src;
+  uint64_t sum = 0;
+  size_t i;
+
+  for (i = 0; i < size / sizeof *p; i++)
+    sum += p[i];
+
+  return sum;
+}
+
+static void write_libc(void *dst, int value, size_t size) {
+  memset(dst, value, size);
+}
+
+static void copy_libc(void *dst, const void *src, size_t size) {
+  memcpy(dst, src, size);
+}
+
+/* Not a real transpose: reorders chunks of 9000 ints with memcpy(), as earlier versions did. */
+static void transpose_libc(void *dst, const void *src, const struct transpose_dims *dims) {
+  #define XPOSE_CHUNK       (9000 * sizeof(int)) /* size of data chunks to reorder, in bytes */
+  const size_t nr_chunks = dims->stations * dims->subbands * dims->times * sizeof(uint64_t) / XPOSE_CHUNK;
+  size_t i;
+
+  for (i = 0; i < nr_chunks; i++)
+    memcpy((uint8_t *)dst + i * XPOSE_CHUNK, (const uint8_t *)src + (i * 7) % nr_chunks * XPOSE_CHUNK, XPOSE_CHUNK);
+}
+
+/* ----- scalar: 64-bit words, 4 independent accumulators */
+
+static uint64_t read_scalar(const void *src, size_t size) {
+  const uint64_t *p = src;
+  const size_t n = size / sizeof *p;
+  uint64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    a0 += p[i];
+    a1 += p[i + 1];
+    a2 += p[i + 2];
+    a3 += p[i + 3];
+  }
+
+  return a0 + a1 + a2 + a3 + read_bytes((const uint8_t *)(p + i), size - i * sizeof *p);
+}
+
+static void write_scalar(void *dst, int value, size_t size) {
+  const uint64_t v = 0x0101010101010101ULL * (uint8_t)value;
+  uint64_t *p = dst;
+  const size_t n = size / sizeof *p;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    p[i] = v;
+
+  memset(p + n, value, size - n * sizeof *p);
+}
+
+static void copy_scalar(void *dst, const void *src, size_t size) {
+  uint64_t *d = dst;
+  const uint64_t *s = src;
+  const size_t n = size / sizeof *d;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    d[i] = s[i];
+
+  memcpy(d + n, s + n, size - n * sizeof *d);
+}
+
+static void transpose_scalar(void *dst, const void *src, const struct transpose_dims *dims) {
+  transpose_blocked(dst, src, dims, tile_scalar);
+}
+
+#ifdef __x86_64__
+
+/* ----- SSE2: part of x86-64, so always available */
+
+static uint64_t read_sse2(const void *src, size_t size) {
+  const uint8_t *p = src;
+  __m128i a0 = _mm_setzero_si128(), a1 = a0, a2 = a0, a3 = a0;
+  uint64_t lanes[2];
+  size_t i;
+
+  for (i = 0; i + 64 <= size; i += 64) {
+    a0 = _mm_add_epi64(a0, _mm_loadu_si128((const __m128i *)(p + i)));
+    a1 = _mm_add_epi64(a1, _mm_loadu_si128((const __m128i *)(p + i + 16)));
+    a2 = _mm_add_epi64(a2, _mm_loadu_si128((const __m128i *)(p + i + 32)));
+    a3 = _mm_add_epi64(a3, _mm_loadu_si128((const __m128i *)(p + i + 48)));
+  }
+
+  a0 = _mm_add_epi64(_mm_add_epi64(a0, a1), _mm_add_epi64(a2, a3));
+  _mm_storeu_si128((__m128i *)lanes, a0);
+
+  return lanes[0] + lanes[1] + read_bytes(p + i, size - i);
+}
+
+static void write_sse2(void *dst, int value, size_t size) {
+  uint8_t *p = dst;
+  const size_t head = head_bytes(p, 16, size);
+  const __m128i v = _mm_set1_epi8(value);
+  size_t i;
+
+  memset(p, value, head);
+  p += head;
+  size -= head;
+
+  for (i = 0; i + 64 <= size; i += 64) {
+    _mm_stream_si128((__m128i *)(p + i), v);
+    _mm_stream_si128((__m128i *)(p + i + 16), v);
+    _mm_stream_si128((__m128i *)(p + i + 32), v);
+    _mm_stream_si128((__m128i *)(p + i + 48), v);
+  }
+
+  _mm_sfence();
+  memset(p + i, value, size - i);
+}
+
+static void copy_sse2(void *dst, const void *src, size_t size) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  const size_t head = head_bytes(d, 16, size);
+  size_t i;
+
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+
+  for (i = 0; i + 64 <= size; i += 64) {
+    const __m128i v0 = _mm_loadu_si128((const __m128i *)(s + i));
+    const __m128i v1 = _mm_loadu_si128((const __m128i *)(s + i + 16));
+    const __m128i v2 = _mm_loadu_si128((const __m128i *)(s + i + 32));
+    const __m128i v3 = _mm_loadu_si128((const __m128i *)(s + i + 48));
+
+    _mm_stream_si128((__m128i *)(d + i), v0);
+    _mm_stream_si128((__m128i *)(d + i + 16), v1);
+    _mm_stream_si128((__m128i *)(d + i + 32), v2);
+    _mm_stream_si128((__m128i *)(d + i + 48), v3);
+  }
+
+  _mm_sfence();
+  memcpy(d + i, s + i, size - i);
+}
+
+/* 2x2 tiles: two samples per register */
+static void tile_sse2(uint64_t *dst, size_t dst_stride, const uint64_t *src, size_t src_stride, size_t rows, size_t cols) {
+  size_t r, c;
+
+  for (r = 0; r + 2 <= rows; r += 2) {
+    for (c = 0; c + 2 <= cols; c += 2) {
+      const __m128i r0 = _mm_loadu_si128((const __m128i *)&src[r * src_stride + c]);
+      const __m128i r1 = _mm_loadu_si128((const __m128i *)&src[(r + 1) * src_stride + c]);
+
+      _mm_storeu_si128((__m128i *)&dst[c * dst_stride + r], _mm_unpacklo_epi64(r0, r1));
+      _mm_storeu_si128((__m128i *)&dst[(c + 1) * dst_stride + r], _mm_unpackhi_epi64(r0, r1));
+    }
+
+    /* remaining columns */
+    tile_scalar(dst + c * dst_stride + r, dst_stride, src + r * src_stride + c, src_stride, 2, cols - c);
+  }
+
+  /* remaining rows */
+  tile_scalar(dst + r, dst_stride, src + r * src_stride, src_stride, rows - r, cols);
+}
+
+static void transpose_sse2(void *dst, const void *src, const struct transpose_dims *dims) {
+  transpose_blocked(dst, src, dims, tile_sse2);
+}
+
+/* ----- AVX2 */
+
+__attribute__((target("avx2")))
+static uint64_t read_avx2(const void *src, size_t size) {
+  const uint8_t *p = src;
+  __m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+  uint64_t lanes[4];
+  size_t i;
+
+  for (i = 0; i + 128 <= size; i += 128) {
+    a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i *)(p + i)));
+    a1 = _mm256_add_epi64(a1, _mm256_loadu_si256((const __m256i *)(p + i + 32)));
+    a2 = _mm256_add_epi64(a2, _mm256_loadu_si256((const __m256i *)(p + i + 64)));
+    a3 = _mm256_add_epi64(a3, _mm256_loadu_si256((const __m256i *)(p + i + 96)));
+  }
+
+  a0 = _mm256_add_epi64(_mm256_add_epi64(a0, a1), _mm256_add_epi64(a2, a3));
+  _mm256_storeu_si256((__m256i *)lanes, a0);
+
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + read_bytes(p + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void write_avx2(void *dst, int value, size_t size) {
+  uint8_t *p = dst;
+  const size_t head = head_bytes(p, 32, size);
+  const __m256i v = _mm256_set1_epi8(value);
+  size_t i;
+
+  memset(p, value, head);
+  p += head;
+  size -= head;
+
+  for (i = 0; i + 128 <= size; i += 128) {
+    _mm256_stream_si256((__m256i *)(p + i), v);
+    _mm256_stream_si256((__m256i *)(p + i + 32), v);
+    _mm256_stream_si256((__m256i *)(p + i + 64), v);
+    _mm256_stream_si256((__m256i *)(p + i + 96), v);
+  }
+
+  _mm_sfence();
+  memset(p + i, value, size - i);
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2(void *dst, const void *src, size_t size) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  const size_t head = head_bytes(d, 32, size);
+  size_t i;
+
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+
+  for (i = 0; i + 128 <= size; i += 128) {
+    const __m256i v0 = _mm256_loadu_si256((const __m256i *)(s + i));
+    const __m256i v1 = _mm256_loadu_si256((const __m256i *)(s + i + 32));
+    const __m256i v2 = _mm256_loadu_si256((const __m256i *)(s + i + 64));
+    const __m256i v3 = _mm256_loadu_si256((const __m256i *)(s + i + 96));
+
+    _mm256_stream_si256((__m256i *)(d + i), v0);
+    _mm256_stream_si256((__m256i *)(d + i + 32), v1);
+    _mm256_stream_si256((__m256i *)(d + i + 64), v2);
+    _mm256_stream_si256((__m256i *)(d + i + 96), v3);
+  }
+
+  _mm_sfence();
+  memcpy(d + i, s + i, size - i);
+}
+
+/* 4x4 tiles: four samples per register */
+__attribute__((target("avx2")))
+static void tile_avx2(uint64_t *dst, size_t dst_stride, const uint64_t *src, size_t src_stride, size_t rows, size_t cols) {
+  size_t r, c;
+
+  for (r = 0; r + 4 <= rows; r += 4) {
+    for (c = 0; c + 4 <= cols; c += 4) {
+      const __m256i r0 = _mm256_loadu_si256((const __m256i *)&src[r * src_stride + c]);
+      const __m256i r1 = _mm256_loadu_si256((const __m256i *)&src[(r + 1) * src_stride + c]);
+      const __m256i r2 = _mm256_loadu_si256((const __m256i *)&src[(r + 2) * src_stride + c]);
+      const __m256i r3 = _mm256_loadu_si256((const __m256i *)&src[(r + 3) * src_stride + c]);
+
+      /* [r0c0 r1c0 r0c2 r1c2], [r0c1 r1c1 r0c3 r1c3], and likewise for r2 and r3 */
+      const __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+      const __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+      const __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+      const __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+
+      _mm256_storeu_si256((__m256i *)&dst[c * dst_stride + r],       _mm256_permute2x128_si256(t0, t2, 0x20));
+      _mm256_storeu_si256((__m256i *)&dst[(c + 1) * dst_stride + r], _mm256_permute2x128_si256(t1, t3, 0x20));
+      _mm256_storeu_si256((__m256i *)&dst[(c + 2) * dst_stride + r], _mm256_permute2x128_si256(t0, t2, 0x31));
+      _mm256_storeu_si256((__m256i *)&dst[(c + 3) * dst_stride + r], _mm256_permute2x128_si256(t1, t3, 0x31));
+    }
+
+    /* remaining columns */
+    tile_scalar(dst + c * dst_stride + r, dst_stride, src + r * src_stride + c, src_stride, 4, cols - c);
+  }
+
+  /* remaining rows */
+  tile_scalar(dst + r, dst_stride, src + r * src_stride, src_stride, rows - r, cols);
+}
+
+static void transpose_avx2(void *dst, const void *src, const struct transpose_dims *dims) {
+  transpose_blocked(dst, src, dims, tile_avx2);
+}
+
+/* ----- AVX-512 */
+
+__attribute__((target("avx512f")))
+static uint64_t read_avx512(const void *src, size_t size) {
+  const uint8_t *p = src;
+  __m512i a0 = _mm512_setzero_si512(), a1 = a0, a2 = a0, a3 = a0;
+  size_t i;
+
+  for (i = 0; i + 256 <= size; i += 256) {
+    a0 = _mm512_add_epi64(a0, _mm512_loadu_si512((const void *)(p + i)));
+    a1 = _mm512_add_epi64(a1, _mm512_loadu_si512((const void *)(p + i + 64)));
+    a2 = _mm512_add_epi64(a2, _mm512_loadu_si512((const void *)(p + i + 128)));
+    a3 = _mm512_add_epi64(a3, _mm512_loadu_si512((const void *)(p + i + 192)));
+  }
+
+  a0 = _mm512_add_epi64(_mm512_add_epi64(a0, a1), _mm512_add_epi64(a2, a3));
+
+  return _mm512_reduce_add_epi64(a0) + read_bytes(p + i, size - i);
+}
+
+__attribute__((target("avx512f")))
+static void write_avx512(void *dst, int value, size_t size) {
+  uint8_t *p = dst;
+  const size_t head = head_bytes(p, 64, size);
+  const __m512i v = _mm512_set1_epi32(0x01010101 * (uint8_t)value);
+  size_t i;
+
+  memset(p, value, head);
+  p += head;
+  size -= head;
+
+  for (i = 0; i + 256 <= size; i += 256) {
+    _mm512_stream_si512((void *)(p + i), v);
+    _mm512_stream_si512((void *)(p + i + 64), v);
+    _mm512_stream_si512((void *)(p + i + 128), v);
+    _mm512_stream_si512((void *)(p + i + 192), v);
+  }
+
+  _mm_sfence();
+  memset(p + i, value, size - i);
+}
+
+__attribute__((target("avx512f")))
+static void copy_avx512(void *dst, const void *src, size_t size) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  const size_t head = head_bytes(d, 64, size);
+  size_t i;
+
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+
+  for (i = 0; i + 256 <= size; i += 256) {
+    const __m512i v0 = _mm512_loadu_si512((const void *)(s + i));
+    const __m512i v1 = _mm512_loadu_si512((const void *)(s + i + 64));
+    const __m512i v2 = _mm512_loadu_si512((const void *)(s + i + 128));
+    const __m512i v3 = _mm512_loadu_si512((const void *)(s + i + 192));
+
+    _mm512_stream_si512((void *)(d + i), v0);
+    _mm512_stream_si512((void *)(d + i + 64), v1);
+    _mm512_stream_si512((void *)(d + i + 128), v2);
+    _mm512_stream_si512((void *)(d + i + 192), v3);
+  }
+
+  _mm_sfence();
+  memcpy(d + i, s + i, size - i);
+}
+
+#endif /* __x86_64__ */
+
+static const struct kernels all_kernels[] = {
+  { KERNEL_LIBC,   "libc",   read_libc,   write_libc,   copy_libc,   transpose_libc },
+  { KERNEL_SCALAR, "scalar", read_scalar, write_scalar, copy_scalar, transpose_scalar },
+#ifdef __x86_64__
+  { KERNEL_SSE2,   "sse2",   read_sse2,   write_sse2,   copy_sse2,   transpose_sse2 },
+  { KERNEL_AVX2,   "avx2",   read_avx2,   write_avx2,   copy_avx2,   transpose_avx2 },
+  /* 8x8 tiles would need more shuffles than they save, so reuse the AVX2 transpose */
+  { KERNEL_AVX512, "avx512", read_avx512, write_avx512, copy_avx512, transpose_avx2 },
+#endif
+};
+
+#define NR_KERNELS (sizeof all_kernels / sizeof all_kernels[0])
+
+static int supported(kernel_t kernel) {
+  switch (kernel) {
+#ifdef __x86_64__
+    case KERNEL_AVX512: return __builtin_cpu_supports("avx512f");
+    case KERNEL_AVX2:   return __builtin_cpu_supports("avx2");
+#endif
+    default:            return 1;
+  }
+}
+
+const struct kernels *select_kernels(kernel_t kernel) {
+  int i;
+
+  if (kernel == KERNEL_AUTO) {
+    /* the table is ordered from narrowest to widest */
+    for (i = NR_KERNELS - 1; i >= 0; i--) {
+      if (supported(all_kernels[i].kernel))
+        return &all_kernels[i];
+    }
+  }
+
+  for (i = 0; i < NR_KERNELS; i++) {
+    if (all_kernels[i].kernel == kernel)
+      return supported(kernel) ? &all_kernels[i] : NULL;
+  }
+
+  return NULL;
+}
+
+const char *kernel_name(kernel_t kernel) {
+  switch (kernel) {
+    case KERNEL_AUTO:   return "auto";
+    case KERNEL_LIBC:   return "libc";
+    case KERNEL_SCALAR: return "scalar";
+    case KERNEL_SSE2:   return "sse2";
+    case KERNEL_AVX2:   return "avx2";
+    case KERNEL_AVX512: return "avx512";
+  }
+
+  return "???";
+}
+
+int parse_kernel(const char *name, kernel_t *kernel) {
+  kernel_t k;
+
+  for (k = KERNEL_AUTO; k <= KERNEL_AVX512; k++) {
+    if (!strcmp(name, kernel_name(k))) {
+      *kernel = k;
+      return 0;
+    }
+  }
+
+  return -1;
+}
@@ -0,0 +1,51 @@
+#ifndef __MEM_KERNELS__
+#define __MEM_KERNELS__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Instruction set to move memory with. */
+typedef enum {
+  KERNEL_AUTO,   /* widest kernel supported by this CPU */
+  KERNEL_LIBC,   /* memset()/memcpy(), and a scalar read */
+  KERNEL_SCALAR, /* 64-bit loads and stores */
+  KERNEL_SSE2,   /* 128-bit loads, non-temporal stores */
+  KERNEL_AVX2,   /* 256-bit loads, non-temporal stores */
+  KERNEL_AVX512  /* 512-bit loads, non-temporal stores */
+} kernel_t;
+
+/* Dimensions of a block of complex samples (8 bytes each) to transpose. */
+struct transpose_dims {
+  size_t stations;
+  size_t subbands;
+  size_t times;
+};
+
+/* A set of kernels for one instruction set. */
+struct kernels {
+  kernel_t kernel;
+  const char *name;
+
+  /* Load all of `src', and return a checksum of it, which must be used to keep the loads live. */
+  uint64_t (*read)(const void *src, size_t size);
+
+  /* Fill `dst' with `value', bypassing the caches where possible. */
+  void (*write)(void *dst, int value, size_t size);
+
+  /* Copy `src' to `dst', bypassing the caches for `dst' where possible. */
+  void (*copy)(void *dst, const void *src, size_t size);
+
+  /* Reorder the samples in `src' from [time][station][subband] to [subband][station][time] in `dst'. */
+  void (*transpose)(void *dst, const void *src, const struct transpose_dims *dims);
+};
+
+/* Return the kernels for `kernel', or NULL if this CPU does not support them.
+ * KERNEL_AUTO selects the widest kernels supported. */
+const struct kernels *select_kernels(kernel_t kernel);
+
+const char *kernel_name(kernel_t kernel);
+
+/* Parse a name into a kernel. Return 0 on success, -1 if the name is unknown. */
+int parse_kernel(const char *name, kernel_t *kernel);
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem-progress.h"
+
+void progress_init(struct progress_log *log, uint64_t expected_ns) {
+  memset(log, 0, sizeof *log);
+
+  /* room for the whole run, so the stage does not need to grow the log */
+  log->capacity = expected_ns / PROGRESS_INTERVAL_NS + 16;
+  log->entries  = malloc(log->capacity * sizeof *log->entries);
+
+  if (!log->entries) {
+    printf("ERROR: Could not allocate a progress log of %lu entries.\n", log->capacity);
+    exit(EXIT_FAILURE);
+  }
+}
+
+void progress_free(struct progress_log *log) {
+  free(log->entries);
+  memset(log, 0, sizeof *log);
+}
+
+static void append(struct progress_log *log, uint64_t now, uint64_t bytes, uint64_t late) {
+  if (log->nr_entries == log->capacity) {
+    log->capacity *= 2;
+    log->entries   = realloc(log->entries, log->capacity * sizeof *log->entries);
+
+    if (!log->entries) {
+      printf("ERROR: Could not allocate a progress log of %lu entries.\n", log->capacity);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  log->entries[log->nr_entries].time_ns = now;
+  log->entries[log->nr_entries].bytes   = bytes;
+  log->entries[log->nr_entries].late    = late;
+  log->nr_entries++;
+}
+
+void progress_add(struct progress_log *log, uint64_t now, uint64_t bytes, uint64_t late) {
+  if (log->nr_entries > 0 && now < log->entries[log->nr_entries - 1].time_ns + PROGRESS_INTERVAL_NS)
+    return;
+
+  append(log, now, bytes, late);
+}
+
+void progress_end(struct progress_log *log, uint64_t now, uint64_t bytes, uint64_t late) {
+  /* replace an entry that is too recent, to keep the intervals even */
+  if (log->nr_entries > 1 && now < log->entries[log->nr_entries - 1].time_ns + PROGRESS_INTERVAL_NS)
+    log->nr_entries--;
+
+  append(log, now, bytes, late);
+}
+
+uint64_t progress_begin_ns(const struct progress_log *log) {
+  return log->nr_entries ? log->entries[0].time_ns : 0;
+}
+
+uint64_t progress_end_ns(const struct progress_log *log) {
+  return log->nr_entries ? log->entries[log->nr_entries - 1].time_ns : 0;
+}
+
+/* Return the totals at time `t', which must lie within the log. */
+static struct progress_entry progress_at(const struct progress_log *log, uint64_t t) {
+  size_t lo = 0, hi = log->nr_entries - 1;
+
+  /* find the last entry at or before t */
+  while (lo < hi) {
+    const size_t mid = (lo + hi + 1) / 2;
+
+    if (log->entries[mid].time_ns <= t)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  const struct progress_entry *a = &log->entries[lo];
+  struct progress_entry e = *a;
+
+  if (lo + 1 < log->nr_entries && t > a->time_ns) {
+    const struct progress_entry *b = &log->entries[lo + 1];
+    const double f = (double)(t - a->time_ns) / (b->time_ns - a->time_ns);
+
+    e.time_ns = t;
+    e.bytes   = a->bytes + (uint64_t)(f * (b->bytes - a->bytes));
+    e.late    = a->late + (uint64_t)(f * (b->late - a->late));
+  }
+
+  return e;
+}
+
+struct progress_entry progress_between(const struct progress_log *log, uint64_t from, uint64_t to) {
+  struct progress_entry d = { 0, 0, 0 };
+
+  if (log->nr_entries == 0)
+    return d;
+
+  /* only the part in which the stage ran */
+  if (from < progress_begin_ns(log)) from = progress_begin_ns(log);
+  if (to   > progress_end_ns(log))   to   = progress_end_ns(log);
+
+  if (to <= from)
+    return d;
+
+  const struct progress_entry a = progress_at(log, from);
+  const struct progress_entry b = progress_at(log, to);
+
+  d.time_ns = to - from;
+  d.bytes   = b.bytes - a.bytes;
+  d.late    = b.late - a.late;
+
+  return d;
+}
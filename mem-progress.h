@@ -0,0 +1,45 @@
+#ifndef __MEM_PROGRESS__
+#define __MEM_PROGRESS__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Minimum time between two entries of a progress log, in ns. */
+#define PROGRESS_INTERVAL_NS 10000000
+
+/* Running totals of a stage at a point in time. */
+struct progress_entry {
+  uint64_t time_ns;  /* on CLOCK_MONOTONIC, see now_ns() */
+  uint64_t bytes;    /* processed */
+  uint64_t late;     /* bytes that were late */
+};
+
+/* Timestamped progress of one stage, kept by the thread running it. The first
+ * entry marks the start of the stage, and the last one its end.
+ */
+struct progress_log {
+  struct progress_entry *entries;
+  size_t nr_entries, capacity;
+};
+
+/* Allocate a log for a stage that is expected to run for `expected_ns'. */
+void progress_init(struct progress_log *log, uint64_t expected_ns);
+
+void progress_free(struct progress_log *log);
+
+/* Record the totals at `now', if PROGRESS_INTERVAL_NS passed since the last entry.
+ * The first call marks the start of the stage. */
+void progress_add(struct progress_log *log, uint64_t now, uint64_t bytes, uint64_t late);
+
+/* Record the final totals, marking the end of the stage. */
+void progress_end(struct progress_log *log, uint64_t now, uint64_t bytes, uint64_t late);
+
+/* Return when the stage started and ended, or 0 if the log is empty. */
+uint64_t progress_begin_ns(const struct progress_log *log);
+uint64_t progress_end_ns(const struct progress_log *log);
+
+/* Return the bytes and late bytes processed between `from' and `to', interpolated
+ * between the entries, and the part of that time in which the stage ran. */
+struct progress_entry progress_between(const struct progress_log *log, uint64_t from, uint64_t to);
+
+#endif
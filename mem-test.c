@@ -1,5 +1,9 @@
+#define _GNU_SOURCE
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
 #include <sys/time.h>
 #include <numa.h>
 #include <assert.h>
@@ -7,224 +11,1174 @@
 #include <pthread.h>
 
 #include "common.h"
-
-/* Total number of packets to process */
-#define NR_PACKETS                      (1024UL*1024)
-
-/* Total number of stations (antenna fields) to simulate */
-#define NR_STATIONS       18 /* 3 * number of 10GbE interfaces */
-
-struct timeval now() {
-  struct timeval result;
-  gettimeofday(&result, 0);
-
-  return result;
-}
-
-/* wait until the deadline for a specific packet has been reached. */
-int wait_for_packet(const struct timeval first_packet_timestamp, size_t offset, double rate_bps) {
-  struct timeval next_packet_at = first_packet_timestamp;
-  timeval_add(&next_packet_at, 1000000 * offset / (rate_bps / 8));
-  return wait_until(next_packet_at);
-}
-
-typedef enum { READ, WRITE, COPY, TRANSPOSE } transfer_t;
+#include "mem-alloc.h"
+#include "mem-characterize.h"
+#include "mem-config.h"
+#include "mem-progress.h"
+#include "perf-counters.h"
+#include "spsc-ring.h"
+#include "work-queue.h"
 
 struct report {
   double desired_speed_gbps;
   double speed_gbps;
   double late_perc;
   int    nr_operations; /* read/write = 1, copy = 2 */
+
+  /* where the buffers actually landed */
+  int    local_node;    /* node of the CPU running the test */
+  int    node;          /* node holding most of the buffers, or -1 if unknown */
+  double node_perc;     /* percentage of the buffers on that node */
+  double huge_perc;     /* percentage of the buffers backed by huge pages */
+  pages_t pages;        /* pages obtained */
+
+  const char *kernel;   /* kernels used */
+
+  struct histogram lateness; /* of the start of each block, in ns */
+
+  size_t nr_bytes;      /* processed */
+  struct perf_values perf; /* of the thread running the stage, if any */
+  struct progress_log progress; /* over time, to find the steady state of all stages */
+
+  /* pipeline mode only */
+  double occupancy;     /* average number of blocks waiting in the input queue */
+  size_t nr_starved;    /* blocks we had to wait for */
+  size_t nr_blocked;    /* free output blocks we had to wait for (backpressure) */
+  double waiting_perc;  /* percentage of the time spent waiting for either */
 };
 
 pthread_barrier_t start_barrier;
 volatile int done = 0;
 
-/* read/write/copy an amount of data with a fixed rate. */
-struct report dram_test(transfer_t operation, const char *desc, size_t nr_bytes, size_t block_size, double gbits_per_sec) {
+/* Return the dimensions of a transpose of a block of `block_size' bytes. */
+static struct transpose_dims block_transpose_dims(const struct stage *stage, const struct transpose_dims *transpose_dims, size_t block_size) {
+  /* a transpose reorders as many whole samples as fit in a block */
+  struct transpose_dims block_dims = *transpose_dims;
+  block_dims.times = block_size / (sizeof(uint64_t) * transpose_dims->stations * transpose_dims->subbands);
+
+  if (stage->operation == TRANSPOSE && block_dims.times == 0) {
+    printf("ERROR: A block of %lu bytes cannot hold %lu stations x %lu subbands.\n", block_size, transpose_dims->stations, transpose_dims->subbands);
+    exit(EXIT_FAILURE);
+  }
+
+  return block_dims;
+}
+
+/* process one block of data */
+static void process_block(const struct kernels *k, transfer_t operation, void *output, const void *input, size_t block_size, const struct transpose_dims *block_dims, volatile uint64_t *checksum) {
+  switch (operation) {
+    case READ:
+      *checksum += k->read(input, block_size);
+      break;
+
+    case WRITE:
+      k->write(output, 42, block_size);
+      break;
+
+    case COPY:
+      k->copy(output, input, block_size);
+      break;
+
+    case TRANSPOSE:
+      k->transpose(output, input, block_dims);
+      break;
+  }
+}
+
+/* Fill in the common fields of a report, and print it. */
+static void finish_report(struct report *result, const struct stage *stage, const struct kernels *k, const struct buffer *input, const struct buffer *output, size_t nr_bytes, size_t late, const struct timer t) {
+  const transfer_t operation = stage->operation;
+
+  result->desired_speed_gbps = stage->gbits_per_sec;
+  result->speed_gbps = nr_bytes / duration(t) / GBPS;
+  result->late_perc = 100.0 * late / nr_bytes;
+  result->nr_bytes = nr_bytes;
+  result->nr_operations = operation == READ || operation == WRITE ? 1 : 2;
+
+  result->local_node = numa_node_of_cpu(sched_getcpu());
+  result->node       = input->actual_node == output->actual_node ? input->actual_node : -1;
+  result->node_perc  = (input->node_perc + output->node_perc) / 2;
+  result->huge_perc  = (input->huge_perc + output->huge_perc) / 2;
+  result->pages      = output->pages; /* allocated as this stage requested */
+  result->kernel     = k->name;
+
+  printf("%-5s (%s): Ran for %.2fs at %.2f Gbit/s, %.2f%% late (p99 %.1f us), %s kernel. Memory on node %d (%.0f%%, CPU on node %d), %.0f%% huge pages.\n", 
+    operation == READ ? "Read" :
+    operation == WRITE ? "Write" :
+    operation == COPY ? "Copy" :
+    operation == TRANSPOSE ? "Xpose" :
+    "???",
+    stage->desc,
+    duration(t),
+    result->speed_gbps,
+    result->late_perc,
+    hist_percentile(&result->lateness, 99.0) / 1e3,
+    result->kernel,
+    result->node,
+    result->node_perc,
+    result->local_node,
+    result->huge_perc);
+
+  if (result->perf.available) {
+    char prefix[MAX_DESC + 32];
+
+    snprintf(prefix, sizeof prefix, "      (%s): Counters:", stage->desc);
+    perf_print(prefix, &result->perf, nr_bytes);
+  }
+}
+
+/* read/write/copy an amount of data with a fixed rate, publishing the progress in `series' (if not NULL). */
+struct report dram_test(const struct stage *stage, const struct transpose_dims *transpose_dims, struct series *series) {
   struct report result;
+  const char *desc = stage->desc;
+  const size_t nr_bytes = stage->nr_bytes;
+  const size_t block_size = stage->block_size;
+  const double gbits_per_sec = stage->gbits_per_sec;
+  const struct kernels *k = select_kernels(stage->kernel);
+
+  /* keeps the reads live */
+  volatile uint64_t checksum = 0;
+
+  memset(&result, 0, sizeof result);
 
   /* Setup */
   printf("Initialising %s...\n", desc);
 
   struct timer t;
 
-  int *packet_input_buffer;
-  int *packet_output_buffer;
-  const size_t nr_elements = block_size / sizeof *packet_input_buffer;
+  struct buffer input, output;
 
-  packet_input_buffer = malloc(block_size);
-  packet_output_buffer = malloc(block_size);
+  buffer_alloc(&input, block_size, stage->placement, stage->pages, 42);
+  buffer_alloc(&output, block_size, stage->placement, stage->pages, 42);
 
-  memset(packet_input_buffer, 42, block_size);
-  memset(packet_output_buffer, 42, block_size);
+  const struct transpose_dims block_dims = block_transpose_dims(stage, transpose_dims, block_size);
+
+  struct perf_counters counters;
+  perf_open(&counters);
+
+  progress_init(&result.progress, (uint64_t)(nr_bytes * 8 / gbits_per_sec));
 
   /* All threads must process at the same time. */
   pthread_barrier_wait(&start_barrier); /* can't use omp barrier, as we want all loops/teams to participate */
   printf("Starting %s...\n", desc);
 
   size_t offset = 0;
-  struct timeval first_packet_timestamp = now();
+  struct pacer pacer;
+  pacer_init(&pacer, PACER_SPIN_NS);
+
+  const uint64_t first_packet_timestamp = now_ns();
 
   size_t late = 0;
 
+  progress_add(&result.progress, first_packet_timestamp, 0, 0);
+
+  perf_start(&counters);
   start(&t);
   while( !done && offset < nr_bytes ) {
     offset += block_size;
 
     /* wait for deadline of next packet according to desired data rate */
-    late += wait_for_packet(first_packet_timestamp, offset, gbits_per_sec * 1000 * 1000 * 1000) * block_size;
-
-    /* process one block of data */
-    switch (operation) {
-      int i, sum = 0;
-      case READ:
-        for( i = 0; i < nr_elements; i++ ) {
-          sum += packet_input_buffer[i];
-        }
-        break;
+    late += pacer_wait(&pacer, first_packet_timestamp + (uint64_t)(offset * 8 / gbits_per_sec)) * block_size;
 
-      case WRITE:
-        memset(packet_output_buffer, 42, block_size);
-        break;
+    process_block(k, stage->operation, output.ptr, input.ptr, block_size, &block_dims, &checksum);
+    series_update(series, offset, offset, late);
+    progress_add(&result.progress, now_ns(), offset, late);
+  }
+  stop(&t);
+  perf_stop(&counters, &result.perf);
+  progress_end(&result.progress, now_ns(), offset, late);
+  done = 1; /* let other threads bail early, as the steady state ends here anyway */
 
-      case COPY:
-        memcpy(packet_output_buffer, packet_input_buffer, block_size);
-        break;
+  /* Report */
+  result.lateness = pacer.lateness;
+  finish_report(&result, stage, k, &input, &output, offset, late, t);
 
-      case TRANSPOSE:
-        #define XPOSE_CHUNK       9000 /* size of data chunks to reorder, in samples */
-        for( i = 0; i < nr_elements / XPOSE_CHUNK; i++ ) {
-          memcpy(&packet_output_buffer[i*XPOSE_CHUNK], &packet_input_buffer[(i * 7) % (nr_elements/XPOSE_CHUNK) * XPOSE_CHUNK], sizeof *packet_input_buffer * XPOSE_CHUNK);
-        }
-        break;
+  /* Teardown */
+  perf_close(&counters);
+  buffer_free(&output);
+  buffer_free(&input);
+
+  return result;
+}
+
+/* ----- Pipeline mode: the stages of a station pass blocks to each other */
+
+/* Number of blocks in flight between two stages. Must be a power of two. */
+#define PIPELINE_DEPTH    8
+
+/* Queues between two consecutive stages. */
+struct link {
+  struct spsc_ring full;   /* blocks produced, waiting for the consumer */
+  struct spsc_ring free;   /* blocks consumed, returned to the producer */
+  struct buffer blocks[PIPELINE_DEPTH];
+};
+
+/* The queues and blocks of a station. */
+struct station_pipeline {
+  size_t block_size;       /* size of all blocks */
+  size_t nr_blocks;        /* number of blocks to pass through the pipeline */
+  struct link links[MAX_STAGES - 1];  /* links[s] connects stage s to stage s + 1 */
+};
+
+/* Allocate the queues of a station, on the memory of the calling thread. */
+struct station_pipeline *station_pipeline_alloc(const struct pipeline *p) {
+  struct station_pipeline *sp = calloc(1, sizeof *sp);
+  int s, b;
+
+  /* every stage must be able to process a whole block */
+  for (s = 0; s < p->nr_stages; s++) {
+    if (p->stages[s].block_size > sp->block_size)
+      sp->block_size = p->stages[s].block_size;
+  }
+
+  sp->nr_blocks = p->stages[0].nr_bytes / sp->block_size;
+
+  for (s = 0; s < p->nr_stages - 1; s++) {
+    struct link *l = &sp->links[s];
+
+    spsc_init(&l->full, PIPELINE_DEPTH);
+    spsc_init(&l->free, PIPELINE_DEPTH);
+
+    /* blocks are placed as their producer wants them */
+    for (b = 0; b < PIPELINE_DEPTH; b++) {
+      buffer_alloc(&l->blocks[b], sp->block_size, p->stages[s].placement, p->stages[s].pages, 42);
+      spsc_push(&l->free, &l->blocks[b]);
+    }
+  }
+
+  return sp;
+}
+
+void station_pipeline_free(struct station_pipeline *sp, const struct pipeline *p) {
+  int s, b;
+
+  for (s = 0; s < p->nr_stages - 1; s++) {
+    for (b = 0; b < PIPELINE_DEPTH; b++)
+      buffer_free(&sp->links[s].blocks[b]);
+
+    spsc_destroy(&sp->links[s].full);
+    spsc_destroy(&sp->links[s].free);
+  }
+
+  free(sp);
+}
+
+/* Pop a block from `r', waiting until one is available. Counts the waits in `nr_waits', and the time waited in `wait_ns'. */
+static struct buffer *wait_pop(struct spsc_ring *r, size_t *nr_waits, uint64_t *wait_ns) {
+  struct buffer *block = spsc_pop(r);
+  int spins = 0;
+
+  if (block)
+    return block;
+
+  const uint64_t begin = now_ns();
+  (*nr_waits)++;
+
+  while (!(block = spsc_pop(r))) {
+    /* spin shortly, then give up the core, as there can be more threads than cores */
+    if (++spins < 64)
+      cpu_relax();
+    else
+      sched_yield();
+  }
+
+  *wait_ns += now_ns() - begin;
+  return block;
+}
+
+/* Run stage `s' of a station in pipeline mode.
+ *
+ * The first stage produces blocks at its rate; the other stages process the blocks
+ * as they arrive from the previous stage. A stage with a reduction only processes
+ * that fraction of each block.
+ */
+struct report pipeline_stage(const struct pipeline *p, int s, struct station_pipeline *sp, struct series *series) {
+  const struct stage *stage = &p->stages[s];
+  const struct kernels *k = select_kernels(stage->kernel);
+  struct link *in  = s > 0 ? &sp->links[s - 1] : NULL;
+  struct link *out = s < p->nr_stages - 1 ? &sp->links[s] : NULL;
+  struct report result;
+  size_t b;
+
+  /* keeps the reads live */
+  volatile uint64_t checksum = 0;
+
+  memset(&result, 0, sizeof result);
+
+  /* fraction of each block to process, rounded down to whole cache lines */
+  const double fraction = stage->nr_bytes < p->stages[0].nr_bytes ? (double)stage->nr_bytes / p->stages[0].nr_bytes : 1.0;
+  const size_t block_size = (size_t)(sp->block_size * fraction) / 64 * 64;
+  const struct transpose_dims block_dims = block_transpose_dims(stage, &p->transpose_dims, block_size);
+
+  /* Setup */
+  printf("Initialising %s...\n", stage->desc);
+
+  struct timer t;
+  struct buffer input, output;
+
+  /* the ends of the pipeline use private buffers */
+  if (!in)  buffer_alloc(&input, sp->block_size, stage->placement, stage->pages, 42);
+  if (!out) buffer_alloc(&output, sp->block_size, stage->placement, stage->pages, 42);
+
+  struct perf_counters counters;
+  perf_open(&counters);
+
+  /* the source sets the pace of the whole station */
+  progress_init(&result.progress, (uint64_t)(sp->nr_blocks * sp->block_size * 8 / p->stages[0].gbits_per_sec));
+
+  /* All threads must process at the same time. */
+  pthread_barrier_wait(&start_barrier);
+  printf("Starting %s...\n", stage->desc);
+
+  struct pacer pacer;
+  pacer_init(&pacer, PACER_SPIN_NS);
+
+  const uint64_t first_packet_timestamp = now_ns();
+
+  size_t late = 0, occupancy = 0;
+  uint64_t wait_ns = 0;
+
+  progress_add(&result.progress, first_packet_timestamp, 0, 0);
+
+  perf_start(&counters);
+  start(&t);
+  for (b = 0; b < sp->nr_blocks; b++) {
+    struct buffer *src = &input, *dst = &output;
+
+    if (!in) {
+      /* the source produces blocks at the desired data rate */
+      late += pacer_wait(&pacer, first_packet_timestamp + (uint64_t)((b + 1) * sp->block_size * 8 / stage->gbits_per_sec)) * block_size;
+    } else {
+      occupancy += spsc_count(&in->full);
+      src = wait_pop(&in->full, &result.nr_starved, &wait_ns);
     }
+
+    if (out)
+      dst = wait_pop(&out->free, &result.nr_blocked, &wait_ns);
+
+    process_block(k, stage->operation, dst->ptr, src->ptr, block_size, &block_dims, &checksum);
+
+    /* pass on the ownership of the blocks */
+    if (in)  spsc_push(&in->free, src);
+    if (out) spsc_push(&out->full, dst);
+
+    series_update(series, (b + 1) * block_size, (b + 1) * block_size, late);
+    progress_add(&result.progress, now_ns(), (b + 1) * block_size, late);
   }
   stop(&t);
-  done = 1; /* let other threads bail early to measure only overlapping speeds */
+  perf_stop(&counters, &result.perf);
+  progress_end(&result.progress, now_ns(), sp->nr_blocks * block_size, late);
 
   /* Report */
-  result.desired_speed_gbps = gbits_per_sec;
-  result.speed_gbps = offset / duration(t) / GBPS;
-  result.late_perc = 100.0 * late / offset;
-  result.nr_operations = operation == READ || operation == WRITE ? 1 : 2;
+  result.lateness     = pacer.lateness;
+  result.occupancy    = in && sp->nr_blocks ? (double)occupancy / sp->nr_blocks : 0.0;
+  result.waiting_perc = 100.0 * wait_ns / 1e9 / duration(t);
 
-  printf("%-5s (%s): Ran for %.2fs at %.2f Gbit/s, %.2f%% late.\n", 
-    operation == READ ? "Read" :
-    operation == WRITE ? "Write" :
-    operation == COPY ? "Copy" :
-    operation == TRANSPOSE ? "Xpose" :
-    "???",
-    desc,
-    duration(t),
-    result.speed_gbps,
-    result.late_perc);
+  finish_report(&result, stage, k, in ? &in->blocks[0] : &input, out ? &out->blocks[0] : &output, sp->nr_blocks * block_size, late, t);
+
+  printf("      (%s): Input queue %.1f of %d blocks on average, waited for %lu input and %lu output blocks, %.1f%% of the time.\n",
+    stage->desc,
+    result.occupancy,
+    PIPELINE_DEPTH,
+    result.nr_starved,
+    result.nr_blocked,
+    result.waiting_perc);
 
   /* Teardown */
-  free(packet_output_buffer);
-  free(packet_input_buffer);
+  perf_close(&counters);
+  if (!in)  buffer_free(&input);
+  if (!out) buffer_free(&output);
 
   return result;
 }
 
+/* ----- Pool mode: a fixed number of workers per NUMA node process the blocks of all stages */
+
+/* Maximum number of CPUs per NUMA node to consider. */
+#define MAX_CPUS          1024
+
+/* How often an idle worker looks for work to steal, in ns. */
+#define POOL_POLL_NS      100000
+
+/* The blocks of one stage of one station. */
+struct task {
+  const struct stage *stage;
+  const struct kernels *k;
+  struct transpose_dims block_dims;
+  int node;                  /* node of the station */
+  int owner;                 /* worker that set up the task */
+  struct series *series;     /* progress, or NULL */
+
+  struct buffer input, output;
+  size_t nr_blocks;
+  size_t next_block;
+  uint64_t first_deadline;
+  double ns_per_block;       /* at the desired rate */
+
+  size_t late;               /* in bytes */
+  struct histogram lateness; /* of the start of each block, in ns */
+  struct progress_log progress;
+  uint64_t begin_ns, end_ns;
+  uint64_t ready_ns;         /* when the previous block was done */
+  uint64_t checksum;
+};
+
+struct worker {
+  int node;
+  int cpu;
+  struct work_queue queue;
+
+  uint64_t busy_ns;
+  size_t nr_local_steals;    /* from workers on the same node */
+  size_t nr_remote_steals;   /* from workers on other nodes */
+
+  struct perf_values perf;   /* tasks move between workers, so we count per worker */
+};
+
+/* Take a due item from another worker, preferring workers on our own node. */
+static int steal(struct worker *workers, int nr_workers, int self, uint64_t now, struct work_item *item) {
+  int pass, i;
+
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 1; i < nr_workers; i++) {
+      struct worker *victim = &workers[(self + i) % nr_workers];
+      const int same_node = victim->node == workers[self].node;
+
+      if (same_node != (pass == 0))
+        continue;
+
+      if (wq_take_due(&victim->queue, now, item)) {
+        if (same_node)
+          workers[self].nr_local_steals++;
+        else
+          workers[self].nr_remote_steals++;
+
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static struct timer task_timer(const struct task *task) {
+  struct timer t;
+
+  t.begin.tv_sec  = task->begin_ns / 1000000000ULL;
+  t.begin.tv_nsec = task->begin_ns % 1000000000ULL;
+  t.end.tv_sec    = task->end_ns / 1000000000ULL;
+  t.end.tv_nsec   = task->end_ns % 1000000000ULL;
+
+  return t;
+}
+
+/* Process all stages of all stations with `workers_per_node' workers on each NUMA node.
+ *
+ * Every block is a work item, due at the same deadline as in the other modes. A
+ * worker processes the due items in its own queue, earliest deadline first, and
+ * queues the next block of a stage itself. If it has nothing due, it steals due
+ * items from other workers on its node first, and from other nodes next.
+ *
+ * The hardware counters of all workers are added to `perf'. If `series' is not
+ * NULL, the progress of stage s of station i is published in series[i * nr_stages + s].
+ */
+void pool_test(const struct pipeline *p, int workers_per_node, struct report *reports, struct perf_values *perf, struct series *series) {
+  const int nr_nodes = nrNodes();
+  const int nr_workers = workers_per_node * nr_nodes;
+  const size_t nr_tasks = (size_t)p->nr_stations * p->nr_stages;
+  struct worker *workers = calloc(nr_workers, sizeof *workers);
+  struct task *tasks = calloc(nr_tasks, sizeof *tasks);
+  size_t nr_done = 0;
+  uint64_t begin_ns = 0, end_ns = 0;
+  int node, w;
+  size_t i;
+
+  /* pin the workers of each node to its CPUs */
+  for (node = 0; node < nr_nodes; node++) {
+    int cpus[MAX_CPUS];
+    const int nr_cpus = nodeCpus(node, cpus, MAX_CPUS);
+
+    if (nr_cpus == 0) {
+      printf("ERROR: NUMA node %d has no CPUs to run workers on.\n", node);
+      exit(EXIT_FAILURE);
+    }
+
+    for (w = 0; w < workers_per_node; w++) {
+      struct worker *worker = &workers[node * workers_per_node + w];
+
+      worker->node = node;
+      worker->cpu  = cpus[w % nr_cpus];
+      wq_init(&worker->queue, nr_tasks);
+    }
+  }
+
+  /* spread the stations over the nodes, and their stages over the workers of that node */
+  for (i = 0; i < nr_tasks; i++) {
+    struct task *task = &tasks[i];
+    const int station = i / p->nr_stages;
+
+    task->stage = &p->stages[i % p->nr_stages];
+    task->k     = select_kernels(task->stage->kernel);
+    task->node  = station % nr_nodes;
+    task->series = series ? &series[i] : NULL;
+    task->owner = task->node * workers_per_node + (i / nr_nodes) % workers_per_node;
+    task->nr_blocks    = task->stage->nr_bytes / task->stage->block_size;
+    task->ns_per_block = task->stage->block_size * 8 / task->stage->gbits_per_sec;
+    task->block_dims   = block_transpose_dims(task->stage, &p->transpose_dims, task->stage->block_size);
+    progress_init(&task->progress, (uint64_t)(task->nr_blocks * task->ns_per_block));
+  }
+
+  printf("Using %d workers on %d NUMA nodes for %lu stages.\n", nr_workers, nr_nodes, nr_tasks);
+
+  #pragma omp parallel num_threads(nr_workers)
+  {
+    if (omp_get_num_threads() != nr_workers) {
+      /* the tasks of the missing workers would never get their buffers */
+      printf("ERROR: Could only start %d of %d workers. Check OMP_THREAD_LIMIT.\n", omp_get_num_threads(), nr_workers);
+      exit(EXIT_FAILURE);
+    }
+
+    const int self = omp_get_thread_num();
+    struct worker *worker = &workers[self];
+    struct perf_counters counters;
+    struct work_item item;
+    size_t t;
+
+    setNodeAffinity(worker->node);
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(worker->cpu, &cpuset);
+    checkSyscall("sched_setaffinity()", sched_setaffinity(0, sizeof cpuset, &cpuset));
+
+    /* allocate the buffers of our tasks on our node */
+    for (t = 0; t < nr_tasks; t++) {
+      struct task *task = &tasks[t];
+
+      if (task->owner != self)
+        continue;
+
+      buffer_alloc(&task->input, task->stage->block_size, task->stage->placement, task->stage->pages, 42);
+      buffer_alloc(&task->output, task->stage->block_size, task->stage->placement, task->stage->pages, 42);
+    }
+
+    perf_open(&counters);
+
+    #pragma omp barrier
+    #pragma omp single
+    {
+      printf("Starting...\n");
+      begin_ns = now_ns();
+
+      /* queue the first block of every stage */
+      for (t = 0; t < nr_tasks; t++) {
+        struct task *task = &tasks[t];
+
+        task->first_deadline = begin_ns + task->ns_per_block;
+        task->ready_ns       = begin_ns;
+        item.deadline = task->first_deadline;
+        item.task     = task;
+
+        if (task->nr_blocks > 0)
+          wq_push(&workers[task->owner].queue, item);
+        else
+          nr_done++;
+      }
+    }
+    /* implicit barrier */
+
+    perf_start(&counters);
+
+    while (__atomic_load_n(&nr_done, __ATOMIC_ACQUIRE) < nr_tasks) {
+      uint64_t now = now_ns();
+
+      if (!wq_take_due(&worker->queue, now, &item) && !steal(workers, nr_workers, self, now, &item)) {
+        /* nothing due: as pacer_wait(), sleep until shortly before our next deadline and spin
+         * for the rest, but wake up in between to look for work to steal */
+        const uint64_t next = wq_next_deadline(&worker->queue);
+
+        if (next > now + PACER_SPIN_NS) {
+          const uint64_t wake_at = next - PACER_SPIN_NS < now + POOL_POLL_NS ? next - PACER_SPIN_NS : now + POOL_POLL_NS;
+          const struct timespec ts = { wake_at / 1000000000ULL, wake_at % 1000000000ULL };
+
+          clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        } else {
+          cpu_relax();
+        }
+        continue;
+      }
+
+      /* process the block */
+      struct task *task = item.task;
+      const uint64_t block_begin = now_ns();
+
+      if (task->next_block == 0) {
+        task->begin_ns = block_begin;
+        progress_add(&task->progress, block_begin, 0, 0);
+      }
+
+      /* late if the stage was not ready for the block before its deadline, which is when
+       * pacer_wait() counts a block as late in the other modes */
+      if (task->ready_ns > item.deadline)
+        task->late += task->stage->block_size;
+
+      hist_add(&task->lateness, block_begin - item.deadline);
+
+      process_block(task->k, task->stage->operation, task->output.ptr, task->input.ptr, task->stage->block_size, &task->block_dims, (volatile uint64_t *)&task->checksum);
+
+      const uint64_t block_end = now_ns();
+      worker->busy_ns += block_end - block_begin;
+      task->ready_ns = block_end;
+
+      series_update(task->series, (task->next_block + 1) * task->stage->block_size, (task->next_block + 1) * task->stage->block_size, task->late);
+      progress_add(&task->progress, block_end, (task->next_block + 1) * task->stage->block_size, task->late);
+
+      /* queue the next block ourselves, as it will likely find its data in our caches */
+      if (++task->next_block < task->nr_blocks) {
+        item.deadline = task->first_deadline + (uint64_t)(task->next_block * task->ns_per_block);
+        wq_push(&worker->queue, item);
+      } else {
+        task->end_ns = block_end;
+        progress_end(&task->progress, block_end, task->nr_blocks * task->stage->block_size, task->late);
+        __atomic_add_fetch(&nr_done, 1, __ATOMIC_RELEASE);
+      }
+    }
+
+    perf_stop(&counters, &worker->perf);
+    perf_close(&counters);
+
+    #pragma omp barrier
+    #pragma omp single
+    end_ns = now_ns();
+
+    /* report from the node of the stage */
+    for (t = 0; t < nr_tasks; t++) {
+      struct task *task = &tasks[t];
+
+      if (task->owner != self)
+        continue;
+
+      reports[t].lateness = task->lateness;
+      reports[t].progress = task->progress;
+      finish_report(&reports[t], task->stage, task->k, &task->input, &task->output, task->nr_blocks * task->stage->block_size, task->late, task_timer(task));
+
+      buffer_free(&task->output);
+      buffer_free(&task->input);
+    }
+  }
+
+  /* worker statistics */
+  uint64_t busy_ns = 0;
+  size_t nr_local_steals = 0, nr_remote_steals = 0;
+
+  for (w = 0; w < nr_workers; w++) {
+    busy_ns          += workers[w].busy_ns;
+    nr_local_steals  += workers[w].nr_local_steals;
+    nr_remote_steals += workers[w].nr_remote_steals;
+    perf_values_add(perf, &workers[w].perf);
+    wq_destroy(&workers[w].queue);
+  }
+
+  const double cores_busy = (double)busy_ns / (end_ns - begin_ns);
+
+  printf(" ----- Pool results -----\n");
+  printf("Workers:         %d (%d per node)\n", nr_workers, workers_per_node);
+  printf("Cores busy:      %.2f (%.1f%% of the workers, %.3f per station)\n", cores_busy, 100.0 * cores_busy / nr_workers, cores_busy / p->nr_stations);
+  printf("Steals:          %lu within a node, %lu across nodes\n", nr_local_steals, nr_remote_steals);
+  perf_print("Worker counters:", perf, 0.0);
+
+  free(tasks);
+  free(workers);
+}
+
+/* ----- Steady state: the stages start and finish at different times, so only the
+ * window in which all of them ran shows their speed under full concurrent load */
+
+/* Totals of all stages over one phase of the test. */
+struct phase {
+  uint64_t begin_ns, end_ns;
+  double speed_gbps;     /* of all stages together */
+  double late_perc;
+  int slowest;           /* stage that ran the whole phase furthest below its desired speed, or -1 */
+  double slowest_perc;   /* its speed, as a percentage of its desired speed */
+};
+
+static struct phase phase_totals(const struct report *reports, int nr_reports, uint64_t begin_ns, uint64_t end_ns) {
+  struct phase ph;
+  double bytes = 0.0, late = 0.0, speed_bytes = 0.0;
+  int i;
+
+  memset(&ph, 0, sizeof ph);
+  ph.begin_ns = begin_ns;
+  ph.end_ns   = end_ns;
+  ph.slowest  = -1;
+
+  if (end_ns <= begin_ns)
+    return ph;
+
+  for (i = 0; i < nr_reports; i++) {
+    const struct report *r = &reports[i];
+    const struct progress_entry d = progress_between(&r->progress, begin_ns, end_ns);
+
+    bytes       += d.bytes;
+    late        += d.late;
+    speed_bytes += (double)d.bytes * r->nr_operations;
+
+    if (d.time_ns == end_ns - begin_ns) {
+      const double perc = 100.0 * d.bytes / GBPS / (d.time_ns / 1e9) / r->desired_speed_gbps;
+
+      if (ph.slowest < 0 || perc < ph.slowest_perc) {
+        ph.slowest      = i;
+        ph.slowest_perc = perc;
+      }
+    }
+  }
+
+  ph.speed_gbps = speed_bytes / GBPS / ((end_ns - begin_ns) / 1e9);
+  ph.late_perc  = bytes > 0 ? 100.0 * late / bytes : 0.0;
+
+  return ph;
+}
+
+void usage(const char *progname) {
+  printf("Usage: %s [options]\n", progname);
+  printf("       %s -?\n", progname);
+  printf("\n");
+  printf("  -c      Pipeline file describing the stations and stages to emulate [mem-test.conf if present,\n");
+  printf("          or the same pipeline built in].\n");
+  printf("  -a      Buffer placement for all stages: default (follow the station), local or remote (next NUMA node).\n");
+  printf("  -p      Buffer pages for all stages: default, 4k, thp (transparent huge pages), 2m or 1g (explicit huge pages).\n");
+  printf("  -k      Kernels for all stages: auto, libc, scalar, sse2, avx2 or avx512.\n");
+  printf("  -x      Transpose dimensions as stations,subbands.\n");
+  printf("  -m      Mode: independent (every stage uses its own buffers) or pipeline (stages pass blocks\n");
+  printf("          to each other through queues) or pool (a fixed pool of workers per NUMA node processes\n");
+  printf("          all blocks) or characterize (measure speed and latency between all NUMA nodes, and\n");
+  printf("          sweep the working set through the caches) [independent].\n");
+  printf("  -w      Number of workers per NUMA node, for -m pool and characterize [all CPUs of a node].\n");
+  printf("  -z      Largest working set, in MiB, for -m characterize [4x the L3 caches of all CPUs,\n");
+  printf("          at least 64].\n");
+  printf("  -o      Write the results, including the throughput of every stage over time, to this file.\n");
+  printf("  -O      Format of the results: json or csv [json].\n");
+  printf("  -i      Interval between throughput samples, in ms, for -o [100].\n");
+  printf("  -h      Show this help.\n");
+  printf("\n");
+  printf("Options -a, -p, -k and -x override the settings in the pipeline file. With -m characterize,\n");
+  printf("only -p and -k apply.\n");
+}
+
 int main(int argc, char **argv) {
-  #define NR_STEPS          10 /* Must match number of parallel sections below */
+  /* Pipeline to emulate, or NULL for the default. */
+  const char *configFile = NULL;
+  struct pipeline pipeline;
+  /* Overrides from the command line, or NULL. */
+  const char *placementStr = NULL, *pagesStr = NULL, *kernelStr = NULL, *dimsStr = NULL;
+  /* How to run the stages. */
+  enum { INDEPENDENT, PIPELINE, POOL, CHARACTERIZE } mode = INDEPENDENT;
+  /* Number of workers per NUMA node in pool mode, or 0 for all CPUs. */
+  int workersPerNode = 0;
+  /* Structured output, if outputFile is set. */
+  const char *outputFile = NULL;
+  output_format_t outputFormat = OUTPUT_JSON;
+  int intervalMs = 100;
+  /* Largest working set to characterize, or 0 for the default. */
+  size_t maxWorkingSet = 0;
+
+  placement_t placement;
+  pages_t pages;
+  kernel_t kernel;
+  struct transpose_dims dims;
+
+  int opt, i;
+
+  /* parse command-line options */
+  while ((opt = getopt(argc, argv, "c:a:p:k:x:m:w:z:o:O:i:h")) != -1) {
+    switch (opt) {
+    case 'c':
+      configFile = optarg;
+      break;
+
+    case 'a':
+      placementStr = optarg;
+      if (parse_placement(optarg, &placement) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'p':
+      pagesStr = optarg;
+      if (parse_pages(optarg, &pages) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'k':
+      kernelStr = optarg;
+      if (parse_kernel(optarg, &kernel) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'x':
+      dimsStr = optarg;
+      if (sscanf(optarg, "%lu,%lu", &dims.stations, &dims.subbands) != 2
+       || dims.stations < 1 || dims.subbands < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'm':
+      if (!strcmp(optarg, "independent")) {
+        mode = INDEPENDENT;
+      } else if (!strcmp(optarg, "pipeline")) {
+        mode = PIPELINE;
+      } else if (!strcmp(optarg, "pool")) {
+        mode = POOL;
+      } else if (!strcmp(optarg, "characterize")) {
+        mode = CHARACTERIZE;
+      } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'w':
+      workersPerNode = atoi(optarg);
+      if (workersPerNode < 1) {
+        printf("Number of workers per node must be at least 1.\n");
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'z':
+      maxWorkingSet = (size_t)atoi(optarg) << 20;
+      if (maxWorkingSet == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'o':
+      outputFile = optarg;
+      break;
+
+    case 'O':
+      if (parse_output_format(optarg, &outputFormat) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'i':
+      intervalMs = atoi(optarg);
+      if (intervalMs < 1) {
+        printf("Sample interval must be at least 1 ms.\n");
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'h':
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+
+    default: /* '?' */
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* characterize the memory system instead of emulating a pipeline */
+  if (mode == CHARACTERIZE) {
+    struct characterization c = {
+      .k                = select_kernels(kernelStr ? kernel : KERNEL_AUTO),
+      .pages            = pagesStr ? pages : PAGES_DEFAULT,
+      .threads_per_node = workersPerNode,
+      .max_working_set  = maxWorkingSet,
+    };
+
+    if (!c.k) {
+      printf("Kernel %s is not supported by this CPU.\n", kernel_name(kernel));
+      return EXIT_FAILURE;
+    }
+
+    /* well beyond the last-level caches, which the threads of a node may share */
+    if (c.max_working_set == 0)
+      c.max_working_set = 4 * total_cache_size(3) > (64UL << 20) ? 4 * total_cache_size(3) : (64UL << 20);
+
+    printf("Detected %d NUMA nodes.\n", nrNodes());
+    printf("Mode: characterize, %s kernel, pages %s, working sets up to %lu MiB\n",
+      c.k->name, pages_name(c.pages), c.max_working_set >> 20);
+
+    numa_matrix(&c);
+    cache_sweep(&c);
+
+    return EXIT_SUCCESS;
+  }
+
+  /* load the pipeline, and apply the overrides */
+  if (configFile) {
+    load_pipeline(configFile, &pipeline);
+  } else if (access(DEFAULT_PIPELINE_FILE, R_OK) == 0) {
+    configFile = DEFAULT_PIPELINE_FILE;
+    load_pipeline(configFile, &pipeline);
+  } else {
+    /* not started from the source tree */
+    configFile = DEFAULT_PIPELINE_NAME;
+    load_default_pipeline(&pipeline);
+  }
+
+  if (dimsStr)
+    pipeline.transpose_dims = dims;
+
+  for (i = 0; i < pipeline.nr_stages; i++) {
+    struct stage *stage = &pipeline.stages[i];
+
+    if (placementStr) stage->placement = placement;
+    if (pagesStr)     stage->pages = pages;
+    if (kernelStr)    stage->kernel = kernel;
+
+    if (!select_kernels(stage->kernel)) {
+      printf("Kernel %s is not supported by this CPU.\n", kernel_name(stage->kernel));
+      return EXIT_FAILURE;
+    }
+  }
+
+  const int nr_stations = pipeline.nr_stations;
+  const int nr_stages = pipeline.nr_stages;
 
   /* initialise */
-  pthread_barrier_init(&start_barrier, NULL, NR_STATIONS * NR_STEPS);
+  pthread_barrier_init(&start_barrier, NULL, nr_stations * nr_stages);
+
+  if (mode == POOL && workersPerNode == 0) {
+    /* as many workers as the smallest node has CPUs */
+    int cpus[MAX_CPUS], node;
+
+    for (node = 0; node < nrNodes(); node++) {
+      const int nr_cpus = nodeCpus(node, cpus, MAX_CPUS);
+
+      if (workersPerNode == 0 || (nr_cpus > 0 && nr_cpus < workersPerNode))
+        workersPerNode = nr_cpus;
+    }
+  }
 
   omp_set_nested(1);
-  omp_set_num_threads(NR_STATIONS * NR_STEPS);
+  omp_set_num_threads(mode == POOL ? workersPerNode * nrNodes() : nr_stations * nr_stages);
 
   printf("Detected %d NUMA nodes.\n", nrNodes());
   printf("Using %d threads.\n", omp_get_max_threads());
+  printf("Mode: %s\n", mode == PIPELINE ? "pipeline" : mode == POOL ? "pool" : "independent");
+  printf("Pipeline %s: %d stations, %lu packets of %lu bytes, transposes of %lu stations x %lu subbands\n",
+    configFile, nr_stations, pipeline.nr_packets, pipeline.packet_size,
+    pipeline.transpose_dims.stations, pipeline.transpose_dims.subbands);
+
+  for (i = 0; i < nr_stages; i++) {
+    const struct stage *stage = &pipeline.stages[i];
+
+    printf("  %-9s %5lu packets at %5.2f Gbit/s, placement %s, pages %s, kernel %s: %s\n",
+      transfer_name(stage->operation), stage->block_packets, stage->gbits_per_sec,
+      placement_name(stage->placement), pages_name(stage->pages), select_kernels(stage->kernel)->name,
+      stage->desc);
+  }
 
   /* schedule all data transfers in parallel. */
   int station;
-  struct report reports[NR_STATIONS][NR_STEPS];
+  struct report *reports = calloc(nr_stations * nr_stages, sizeof *reports);
+  struct report totals;
+  memset(&totals, 0, sizeof totals);
 
-  /* Not all steps actually execute in COBALT with 1 thread per station.    
-     However, this should be close enough to show fitness for purpose. */
-  #pragma omp parallel for num_threads(NR_STATIONS)
-  for (station = 0; station < NR_STATIONS; station++) {
-    /* Evenly divide stations among the NUMA domains. */
-    setNodeAffinity(station % nrNodes());
-
-    #pragma omp parallel sections num_threads(NR_STEPS)
-    {
-      /* ----- Station data is received in chunks of 128 UDP packets, using recvmmsg */
-      #define UDP_BUFFER_SIZE                 128
+  /* system-wide memory traffic, to compare with what the stages intended to move */
+  struct mc_counters mc;
+  double mcReadBytes, mcWriteBytes;
+  struct timer mcTimer;
+  mc_open(&mc);
 
-      /* NIC -> DRAM */
-      #pragma omp section
-      { reports[station][0] = dram_test( WRITE, "station input (NIC -> DRAM)", NR_PACKETS * 9000, UDP_BUFFER_SIZE * 9000, 3.0 ); }
+  /* time series of every stage of every station */
+  struct sampler sampler;
+  struct series *series = NULL;
 
-      /* kernel -> user space */
-      #pragma omp section
-      { reports[station][1] = dram_test( COPY, "station input (kernel -> user)", NR_PACKETS * 9000, UDP_BUFFER_SIZE * 9000, 3.0 ); }
+  if (outputFile) {
+    sampler_init(&sampler, nr_stations * nr_stages, intervalMs, "late");
+    series = sampler.series;
 
-      /* user space -> MPI input buffer */
-      #pragma omp section
-      { reports[station][2] = dram_test( TRANSPOSE, "station input (user -> IB staging)", NR_PACKETS * 9000, UDP_BUFFER_SIZE * 9000, 3.0 ); }
+    for (i = 0; i < nr_stations * nr_stages; i++)
+      snprintf(series[i].name, sizeof series[i].name, "station %d %s", i / nr_stages, pipeline.stages[i % nr_stages].desc);
 
-      /* ----- We now switch to processing blocks of ~1s */
-      #define PROCESSING_BUFFER_SIZE          1024
+    sampler_start(&sampler);
+  }
 
-      /* MPI exchange */
-      #pragma omp section
-      { reports[station][3] = dram_test( COPY, "station input (IB exchange)", NR_PACKETS * 9000, PROCESSING_BUFFER_SIZE * 9000, 3.0 ); }
+  mc_start(&mc);
+  start(&mcTimer);
 
-      /* Stage to GPU */
-      #pragma omp section
-      { reports[station][4] = dram_test( TRANSPOSE, "station input (GPU staging)", NR_PACKETS * 9000, PROCESSING_BUFFER_SIZE * 9000, 3.0 ); }
+  if (mode == POOL) {
+    pool_test(&pipeline, workersPerNode, reports, &totals.perf, series);
+  } else {
+    /* Not all steps actually execute in COBALT with 1 thread per station.    
+       However, this should be close enough to show fitness for purpose. */
+    #pragma omp parallel for num_threads(nr_stations)
+    for (station = 0; station < nr_stations; station++) {
+      struct station_pipeline *sp = NULL;
+      int s;
 
-      /* DRAM -> GPU */
-      #pragma omp section
-      { reports[station][5] = dram_test( READ, "station input (DRAM -> GPU)", NR_PACKETS * 9000, PROCESSING_BUFFER_SIZE * 9000, 3.0 ); }
+      /* Evenly divide stations among the NUMA domains. */
+      setNodeAffinity(station % nrNodes());
 
-      /* ----- Emulate a minimum reduction of the data volume by this factor */
-      #define REDUCTION_FACTOR                2
+      if (mode == PIPELINE)
+        sp = station_pipeline_alloc(&pipeline);
 
-      /* GPU -> DRAM */
-      #pragma omp section
-      { reports[station][6] = dram_test( WRITE, "processing output (GPU -> DRAM)", NR_PACKETS * 9000 / REDUCTION_FACTOR, PROCESSING_BUFFER_SIZE * 9000, 3.0 / REDUCTION_FACTOR); }
+      /* one thread per stage */
+      #pragma omp parallel for num_threads(nr_stages) schedule(static, 1)
+      for (s = 0; s < nr_stages; s++) {
+        if (omp_get_num_threads() != nr_stages) {
+          /* the start barrier would never be reached by all stages */
+          printf("ERROR: Could only start %d of %d threads for station %d. Check OMP_THREAD_LIMIT.\n", omp_get_num_threads(), nr_stages, station);
+          exit(EXIT_FAILURE);
+        }
 
-      /* Stage output (BF mode) */
-      #pragma omp section
-      { reports[station][7] = dram_test( COPY, "processing output (BF staging)", NR_PACKETS * 9000 / REDUCTION_FACTOR, PROCESSING_BUFFER_SIZE * 9000, 3.0 / REDUCTION_FACTOR); }
+        struct series *stage_series = series ? &series[station * nr_stages + s] : NULL;
 
-      /* Copy output to TCP buffer (BF mode) */
-      #pragma omp section
-      { reports[station][8] = dram_test( COPY, "processing output (user -> kernel)", NR_PACKETS * 9000 / REDUCTION_FACTOR, PROCESSING_BUFFER_SIZE * 9000, 3.0 / REDUCTION_FACTOR); }
+        reports[station * nr_stages + s] = sp ? pipeline_stage(&pipeline, s, sp, stage_series)
+                                              : dram_test(&pipeline.stages[s], &pipeline.transpose_dims, stage_series);
+      }
 
-      /* DRAM -> NIC */
-      #pragma omp section
-      { reports[station][9] = dram_test( READ, "processing output (DRAM -> NIC)", NR_PACKETS * 9000 / REDUCTION_FACTOR, PROCESSING_BUFFER_SIZE * 9000, 3.0 / REDUCTION_FACTOR); }
+      if (sp)
+        station_pipeline_free(sp, &pipeline);
     }
   }
 
+  stop(&mcTimer);
+  mc_stop(&mc, &mcReadBytes, &mcWriteBytes);
+  mc_close(&mc);
+
+  if (outputFile)
+    sampler_stop(&sampler);
+
   /* calculate and show summary */
   printf(" ----- Test results -----\n");
-  struct report totals = { 0.0, 0.0, 0.0, 0 };
-  const int nr_reports = sizeof reports / sizeof reports[0][0];
-  for ( station = 0; station < NR_STATIONS; station++ ) {
-    int i;
+  const int nr_reports = nr_stations * nr_stages;
+  int nr_local = 0, nr_remote = 0, nr_downgraded = 0;
+  hist_init(&totals.lateness);
+  for ( i = 0; i < nr_reports; i++ ) {
+    const struct report *r = &reports[i];
 
-    for ( i = 0; i < NR_STEPS; i++ ) {
-      totals.desired_speed_gbps += reports[station][i].desired_speed_gbps * reports[station][i].nr_operations; /* sum */
-      totals.speed_gbps += reports[station][i].speed_gbps * reports[station][i].nr_operations; /* sum */
-      totals.late_perc  += reports[station][i].late_perc / nr_reports; /* average */
-    }
+    totals.desired_speed_gbps += r->desired_speed_gbps * r->nr_operations; /* sum */
+    totals.speed_gbps += r->speed_gbps * r->nr_operations; /* sum */
+    totals.late_perc  += r->late_perc / nr_reports; /* average */
+    totals.huge_perc  += r->huge_perc / nr_reports; /* average */
+    hist_merge(&totals.lateness, &r->lateness);
+    totals.occupancy  += r->occupancy / nr_reports; /* average */
+    totals.waiting_perc += r->waiting_perc / nr_reports; /* average */
+    totals.nr_starved += r->nr_starved; /* sum */
+    totals.nr_blocked += r->nr_blocked; /* sum */
+    totals.nr_bytes   += r->nr_bytes; /* sum */
+    perf_values_add(&totals.perf, &r->perf); /* sum */
+
+    /* a node of -1 means unknown, or split between the buffers */
+    if (r->node >= 0 && r->node == r->local_node)
+      nr_local++;
+    else if (r->node >= 0)
+      nr_remote++;
+
+    if (r->pages != pipeline.stages[i % nr_stages].pages)
+      nr_downgraded++;
   }
 
+  /* the steady state lasts from the start of the last stage until the end of the first one */
+  uint64_t firstBegin = UINT64_MAX, windowBegin = 0, windowEnd = UINT64_MAX, lastEnd = 0;
+
+  for (i = 0; i < nr_reports; i++) {
+    const struct progress_log *log = &reports[i].progress;
+
+    if (log->nr_entries == 0)
+      continue;
+
+    if (progress_begin_ns(log) < firstBegin)  firstBegin  = progress_begin_ns(log);
+    if (progress_begin_ns(log) > windowBegin) windowBegin = progress_begin_ns(log);
+    if (progress_end_ns(log)   < windowEnd)   windowEnd   = progress_end_ns(log);
+    if (progress_end_ns(log)   > lastEnd)     lastEnd     = progress_end_ns(log);
+  }
+
+  const int steadyState = firstBegin != UINT64_MAX && windowEnd > windowBegin;
+  const struct phase warmup = phase_totals(reports, nr_reports, firstBegin, windowBegin);
+  const struct phase steady = phase_totals(reports, nr_reports, windowBegin, windowEnd);
+  const struct phase drain  = phase_totals(reports, nr_reports, windowEnd, lastEnd);
+
+  /* without a steady state, the averages over the whole run are all we have */
+  const double compliantSpeed = steadyState ? steady.speed_gbps : totals.speed_gbps;
+
   printf("Test version:    %s\n", VERSION);
   printf("Desired speed:   %.2f Gbit/s\n", totals.desired_speed_gbps);
   printf("Measured speed:  %.2f Gbit/s (%.2f%% of desired)\n", totals.speed_gbps, 100.0 * totals.speed_gbps / totals.desired_speed_gbps);
   printf("Average late:    %.3f%%\n", totals.late_perc);
+  hist_print("Lateness:       ", &totals.lateness, 1e3, "us");
+  if (steadyState) {
+    printf("Steady state:    %.3fs with all %d stages running: %.2f Gbit/s (%.2f%% of desired), %.3f%% late\n",
+      (windowEnd - windowBegin) / 1e9, nr_reports, steady.speed_gbps, 100.0 * steady.speed_gbps / totals.desired_speed_gbps, steady.late_perc);
+    if (steady.slowest >= 0)
+      printf("Slowest stage:   station %d (%s) at %.2f%% of its desired speed\n",
+        steady.slowest / nr_stages, pipeline.stages[steady.slowest % nr_stages].desc, steady.slowest_perc);
+    printf("Warm-up:         %.1f ms until the last stage started: %.2f Gbit/s, %.3f%% late\n",
+      (windowBegin - firstBegin) / 1e6, warmup.speed_gbps, warmup.late_perc);
+    printf("Drain:           %.1f ms after the first stage finished: %.2f Gbit/s, %.3f%% late\n",
+      (lastEnd - windowEnd) / 1e6, drain.speed_gbps, drain.late_perc);
+  } else {
+    printf("Steady state:    none, the stages did not all run at the same time\n");
+  }
+  printf("Buffers:         %d local, %d remote, %d unknown; %.1f%% huge pages\n", nr_local, nr_remote, nr_reports - nr_local - nr_remote, totals.huge_perc);
+  if (nr_downgraded)
+    printf("WARNING:         %d stages fell back to transparent huge pages\n", nr_downgraded);
+  perf_print("Counters:       ", &totals.perf, totals.nr_bytes);
+  if (mc.nr_fds == 0)
+    printf("Memory traffic:  unavailable\n");
+  else
+    printf("Memory traffic:  %.2f Gbit/s read, %.2f Gbit/s written (all memory controllers)\n", mcReadBytes / GBPS / duration(mcTimer), mcWriteBytes / GBPS / duration(mcTimer));
+  if (mode == PIPELINE) {
+    printf("Queue occupancy: %.2f of %d blocks on average\n", totals.occupancy, PIPELINE_DEPTH);
+    printf("Waits:           %lu for input, %lu for output (backpressure), %.1f%% of the time\n", totals.nr_starved, totals.nr_blocked, totals.waiting_perc);
+  }
+
+  if (outputFile) {
+    const struct summary_value summary[] = {
+      { "desired_gbps",     totals.desired_speed_gbps },
+      { "measured_gbps",    totals.speed_gbps },
+      { "measured_perc",    100.0 * totals.speed_gbps / totals.desired_speed_gbps },
+      { "late_perc",        totals.late_perc },
+      { "lateness_p99_us",  hist_percentile(&totals.lateness, 99.0) / 1e3 },
+      { "huge_perc",        totals.huge_perc },
+      { "buffers_local",    nr_local },
+      { "buffers_remote",   nr_remote },
+      { "mc_read_gbps",     mc.nr_fds ? mcReadBytes / GBPS / duration(mcTimer) : 0.0 },
+      { "mc_write_gbps",    mc.nr_fds ? mcWriteBytes / GBPS / duration(mcTimer) : 0.0 },
+      { "steady_s",         steadyState ? (windowEnd - windowBegin) / 1e9 : 0.0 },
+      { "steady_gbps",      steady.speed_gbps },
+      { "steady_perc",      100.0 * steady.speed_gbps / totals.desired_speed_gbps },
+      { "steady_late_perc", steady.late_perc },
+      { "warmup_s",         steadyState ? (windowBegin - firstBegin) / 1e9 : 0.0 },
+      { "warmup_gbps",      warmup.speed_gbps },
+      { "drain_s",          steadyState ? (lastEnd - windowEnd) / 1e9 : 0.0 },
+      { "drain_gbps",       drain.speed_gbps },
+    };
+
+    /* see Compliance in README.md */
+    const int pass = compliantSpeed >= 0.9975 * totals.desired_speed_gbps;
+
+    sampler_write(&sampler, outputFile, outputFormat, "mem-test", summary, sizeof summary / sizeof summary[0], pass,
+                  "steady-state speed >= 99.75% of desired speed");
+    sampler_destroy(&sampler);
+  }
 
   /* teardown */
+  for (i = 0; i < nr_reports; i++)
+    progress_free(&reports[i].progress);
+  free(reports);
   pthread_barrier_destroy(&start_barrier);
 
   return EXIT_SUCCESS;
 }
-
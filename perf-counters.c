@@ -0,0 +1,343 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perf-counters.h"
+
+static const char *perf_event_names[NR_PERF_EVENTS] = {
+  "cycles", "instructions", "LLC misses", "dTLB misses", "context switches"
+};
+
+/* glibc does not wrap perf_event_open() */
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+  return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+static void perf_attr(struct perf_event_attr *attr, perf_event_t event, int user_only) {
+  memset(attr, 0, sizeof *attr);
+  attr->size = sizeof *attr;
+  attr->disabled = 1;
+  attr->exclude_hv = 1;
+  attr->exclude_kernel = user_only;
+  attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  switch (event) {
+    case PERF_CYCLES:
+      attr->type   = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+
+    case PERF_INSTRUCTIONS:
+      attr->type   = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+
+    case PERF_LLC_MISSES:
+      attr->type   = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+
+    case PERF_DTLB_MISSES:
+      /* loads only, as most PMUs do not count store misses */
+      attr->type   = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+
+    case PERF_CONTEXT_SWITCHES:
+    default:
+      attr->type   = PERF_TYPE_SOFTWARE;
+      attr->config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+      break;
+  }
+}
+
+/* Open the events of `pc' as a group. Returns -1 if an event needs more privileges,
+ * without opening any. */
+static int perf_open_group(struct perf_counters *pc, int user_only) {
+  struct perf_event_attr attr;
+  perf_event_t e;
+
+  pc->leader = -1;
+  pc->user_only = user_only;
+
+  for (e = 0; e < NR_PERF_EVENTS; e++)
+    pc->fd[e] = -1;
+
+  for (e = 0; e < NR_PERF_EVENTS; e++) {
+    perf_attr(&attr, e, user_only);
+    pc->fd[e] = perf_event_open(&attr, 0, -1, pc->leader, 0);
+
+    if (pc->fd[e] < 0 && (errno == EACCES || errno == EPERM) && !user_only) {
+      perf_close(pc);
+      return -1;
+    }
+
+    if (pc->fd[e] >= 0 && pc->leader < 0)
+      pc->leader = pc->fd[e];
+  }
+
+  return 0;
+}
+
+void perf_open(struct perf_counters *pc) {
+  /* all events must count the same privilege levels, or their ratios are meaningless */
+  if (perf_open_group(pc, 0) < 0) {
+    /* perf_event_paranoid only lets us count user space */
+    perf_open_group(pc, 1);
+  }
+}
+
+void perf_close(struct perf_counters *pc) {
+  perf_event_t e;
+
+  for (e = 0; e < NR_PERF_EVENTS; e++) {
+    if (pc->fd[e] >= 0)
+      close(pc->fd[e]);
+
+    pc->fd[e] = -1;
+  }
+
+  pc->leader = -1;
+}
+
+void perf_start(struct perf_counters *pc) {
+  if (pc->leader < 0)
+    return;
+
+  ioctl(pc->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(pc->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_stop(struct perf_counters *pc, struct perf_values *v) {
+  /* nr, time_enabled, time_running, and a value per event */
+  uint64_t data[3 + NR_PERF_EVENTS];
+  perf_event_t e;
+  int i = 0;
+
+  memset(v, 0, sizeof *v);
+  v->user_only = pc->user_only;
+
+  if (pc->leader < 0)
+    return;
+
+  ioctl(pc->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  if (read(pc->leader, data, sizeof data) < (ssize_t)(3 * sizeof data[0]) || data[2] == 0)
+    return; /* never got onto the PMU */
+
+  /* values are listed in the order in which the events joined the group */
+  const double scale = (double)data[1] / data[2];
+
+  for (e = 0; e < NR_PERF_EVENTS && (uint64_t)i < data[0]; e++) {
+    if (pc->fd[e] < 0)
+      continue;
+
+    v->value[e] = data[3 + i++] * scale;
+    v->available |= 1U << e;
+  }
+}
+
+void perf_values_add(struct perf_values *total, const struct perf_values *v) {
+  perf_event_t e;
+
+  for (e = 0; e < NR_PERF_EVENTS; e++)
+    total->value[e] += v->value[e];
+
+  total->available |= v->available;
+  total->user_only |= v->user_only;
+}
+
+void perf_print(const char *prefix, const struct perf_values *v, double nr_bytes) {
+  const double kib = nr_bytes / 1024.0;
+  perf_event_t e;
+
+  if (!v->available) {
+    printf("%s unavailable\n", prefix);
+    return;
+  }
+
+  printf("%s", prefix);
+
+  if ((v->available & (1U << PERF_CYCLES)) && (v->available & (1U << PERF_INSTRUCTIONS)) && v->value[PERF_CYCLES] > 0.0)
+    printf(" IPC %.2f,", v->value[PERF_INSTRUCTIONS] / v->value[PERF_CYCLES]);
+
+  for (e = 0; e < NR_PERF_EVENTS; e++) {
+    if (!(v->available & (1U << e)))
+      printf(" %s n/a,", perf_event_names[e]);
+    else if ((e == PERF_LLC_MISSES || e == PERF_DTLB_MISSES) && kib > 0.0)
+      printf(" %.3f %s/KiB,", v->value[e] / kib, perf_event_names[e]);
+    else
+      printf(" %.0f %s,", v->value[e], perf_event_names[e]);
+  }
+
+  printf(" %s\n", v->user_only ? "user space only" : "user + kernel");
+}
+
+/* ----- Memory-controller (uncore) counters */
+
+#define UNCORE_DIR "/sys/bus/event_source/devices"
+
+/* Read the first line of UNCORE_DIR/<device>/<file> into buf. Return 0 on success, -1 otherwise. */
+static int read_sysfs(const char *device, const char *file, char *buf, size_t len) {
+  char path[512];
+  FILE *f;
+
+  snprintf(path, sizeof path, "%s/%s/%s", UNCORE_DIR, device, file);
+
+  if (!(f = fopen(path, "r")))
+    return -1;
+
+  if (!fgets(buf, len, f)) {
+    fclose(f);
+    return -1;
+  }
+
+  fclose(f);
+  buf[strcspn(buf, "\n")] = 0;
+  return 0;
+}
+
+/* Translate an event description such as "event=0x04,umask=0x03" into a config
+ * value, using the bit fields in the format/ directory of the device. Return 0
+ * on success, -1 otherwise.
+ */
+static int uncore_config(const char *device, const char *desc, uint64_t *config) {
+  char copy[256], *term, *save;
+
+  snprintf(copy, sizeof copy, "%s", desc);
+  *config = 0;
+
+  for (term = strtok_r(copy, ",", &save); term; term = strtok_r(NULL, ",", &save)) {
+    char *value = strchr(term, '=');
+    char file[128], format[64];
+    unsigned first, last;
+
+    if (!value)
+      return -1;
+
+    *value++ = 0;
+    snprintf(file, sizeof file, "format/%s", term);
+
+    if (read_sysfs(device, file, format, sizeof format) < 0)
+      return -1;
+
+    /* "config:0-7", or "config:21" for a single bit */
+    const int n = sscanf(format, "config:%u-%u", &first, &last);
+    if (n < 1)
+      return -1;
+
+    *config |= strtoull(value, NULL, 0) << first;
+  }
+
+  return 0;
+}
+
+/* Open event `name' of uncore device `device' on all CPUs in its cpumask. */
+static void mc_open_event(struct mc_counters *mc, const char *device, const char *name, int write) {
+  char file[128], buf[256], *cpu, *save;
+  struct perf_event_attr attr;
+  uint64_t config;
+  double scale = 1.0;
+
+  memset(&attr, 0, sizeof attr);
+  attr.size = sizeof attr;
+  attr.disabled = 1;
+
+  if (read_sysfs(device, "type", buf, sizeof buf) < 0)
+    return;
+  attr.type = atoi(buf);
+
+  snprintf(file, sizeof file, "events/%s", name);
+  if (read_sysfs(device, file, buf, sizeof buf) < 0 || uncore_config(device, buf, &config) < 0)
+    return;
+  attr.config = config;
+
+  /* counts are in units of scale * unit, typically 64 bytes expressed in MiB */
+  snprintf(file, sizeof file, "events/%s.scale", name);
+  if (read_sysfs(device, file, buf, sizeof buf) == 0)
+    scale = atof(buf);
+
+  snprintf(file, sizeof file, "events/%s.unit", name);
+  if (read_sysfs(device, file, buf, sizeof buf) == 0 && !strcmp(buf, "MiB"))
+    scale *= 1024.0 * 1024.0;
+
+  /* uncore counters are per socket, and can be read through any of the CPUs listed */
+  if (read_sysfs(device, "cpumask", buf, sizeof buf) < 0)
+    return;
+
+  for (cpu = strtok_r(buf, ",", &save); cpu && mc->nr_fds < MAX_MC_COUNTERS; cpu = strtok_r(NULL, ",", &save)) {
+    const int fd = perf_event_open(&attr, -1, atoi(cpu), -1, 0);
+
+    if (fd < 0)
+      continue;
+
+    mc->fd[mc->nr_fds]    = fd;
+    mc->scale[mc->nr_fds] = scale;
+    mc->write[mc->nr_fds] = write;
+    mc->nr_fds++;
+  }
+}
+
+void mc_open(struct mc_counters *mc) {
+  DIR *dir = opendir(UNCORE_DIR);
+  struct dirent *entry;
+
+  mc->nr_fds = 0;
+
+  if (!dir)
+    return;
+
+  while ((entry = readdir(dir))) {
+    if (strncmp(entry->d_name, "uncore_imc_", strlen("uncore_imc_")))
+      continue;
+
+    mc_open_event(mc, entry->d_name, "cas_count_read", 0);
+    mc_open_event(mc, entry->d_name, "cas_count_write", 1);
+  }
+
+  closedir(dir);
+}
+
+void mc_close(struct mc_counters *mc) {
+  int i;
+
+  for (i = 0; i < mc->nr_fds; i++)
+    close(mc->fd[i]);
+
+  mc->nr_fds = 0;
+}
+
+void mc_start(struct mc_counters *mc) {
+  int i;
+
+  for (i = 0; i < mc->nr_fds; i++) {
+    ioctl(mc->fd[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(mc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void mc_stop(struct mc_counters *mc, double *read_bytes, double *write_bytes) {
+  int i;
+
+  *read_bytes = *write_bytes = 0.0;
+
+  for (i = 0; i < mc->nr_fds; i++) {
+    uint64_t count;
+
+    ioctl(mc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    if (read(mc->fd[i], &count, sizeof count) != sizeof count)
+      continue;
+
+    if (mc->write[i])
+      *write_bytes += count * mc->scale[i];
+    else
+      *read_bytes += count * mc->scale[i];
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef __PERF_COUNTERS__
+#define __PERF_COUNTERS__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Events counted for a thread. */
+typedef enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_CONTEXT_SWITCHES,
+  NR_PERF_EVENTS
+} perf_event_t;
+
+/* Hardware counters of the calling thread, opened as one perf_event group so
+ * they cover exactly the same instructions.
+ *
+ * Events the kernel or PMU do not support (no PMU in a VM, perf_event_paranoid,
+ * ...) are left out, so all functions can be called regardless.
+ */
+struct perf_counters {
+  int fd[NR_PERF_EVENTS];  /* -1 if unavailable */
+  int leader;              /* fd of the group leader, or -1 if no event is available */
+  int user_only;           /* only user space is counted, as the kernel is off limits */
+};
+
+/* Values counted over a period. */
+struct perf_values {
+  double value[NR_PERF_EVENTS];   /* scaled up if the PMU was multiplexed */
+  unsigned available;             /* bit (1 << event) is set if value[event] is valid */
+  int user_only;
+};
+
+/* Open the counters for the calling thread. They start disabled. */
+void perf_open(struct perf_counters *pc);
+
+void perf_close(struct perf_counters *pc);
+
+/* Reset and enable the counters. */
+void perf_start(struct perf_counters *pc);
+
+/* Disable the counters, and store what they counted since perf_start() in `v'. */
+void perf_stop(struct perf_counters *pc, struct perf_values *v);
+
+/* Add the values of `v' to `total'. Events count as available if they are in either. */
+void perf_values_add(struct perf_values *total, const struct perf_values *v);
+
+/* Print "<prefix> IPC, misses, ..." of `v'. Misses are expressed per KiB of the `nr_bytes' processed. */
+void perf_print(const char *prefix, const struct perf_values *v, double nr_bytes);
+
+/* Maximum number of memory-controller counters. */
+#define MAX_MC_COUNTERS 64
+
+/* System-wide traffic of the memory controllers, read from the uncore PMUs
+ * (uncore_imc_*), which requires sufficient privileges.
+ */
+struct mc_counters {
+  int nr_fds;                    /* 0 if unavailable */
+  int fd[MAX_MC_COUNTERS];
+  double scale[MAX_MC_COUNTERS]; /* bytes per count */
+  int write[MAX_MC_COUNTERS];    /* counts writes (cas_count_write) instead of reads */
+};
+
+/* Open the counters of all memory controllers. They start disabled. */
+void mc_open(struct mc_counters *mc);
+
+void mc_close(struct mc_counters *mc);
+
+/* Reset and enable the counters. */
+void mc_start(struct mc_counters *mc);
+
+/* Disable the counters, and return the bytes read and written since mc_start(). */
+void mc_stop(struct mc_counters *mc, double *read_bytes, double *write_bytes);
+
+#endif
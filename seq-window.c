@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "seq-window.h"
+
+void seq_window_init(struct seq_window *w, size_t first_packet_nr) {
+  memset(w, 0, sizeof *w);
+
+  w->first = first_packet_nr;
+  w->base  = first_packet_nr / 64 * 64;
+  w->max   = first_packet_nr;
+
+  /* mark the first packet as received, and the ones below it as not expected */
+  w->bits[(first_packet_nr / 64) % (SEQ_WINDOW_SIZE / 64)] = (2ULL << (first_packet_nr % 64)) - 1;
+  w->received = 1;
+}
+
+/* close the current run of lost packets, if any */
+static void end_burst(struct seq_window *w) {
+  if (w->burst_len == 0)
+    return;
+
+  int bucket = 63 - __builtin_clzll(w->burst_len);
+  if (bucket >= SEQ_BURST_BUCKETS)
+    bucket = SEQ_BURST_BUCKETS - 1;
+
+  w->burst_hist[bucket]++;
+
+  if (w->burst_len > w->max_burst)
+    w->max_burst = w->burst_len;
+
+  w->burst_len = 0;
+}
+
+/* account for the 64 packets starting at w->base, and remove them from the window */
+static void evict_word(struct seq_window *w) {
+  uint64_t *word = &w->bits[(w->base / 64) % (SEQ_WINDOW_SIZE / 64)];
+  const uint64_t received = *word;
+  int bit;
+
+  *word = 0;
+  w->base += 64;
+
+  /* fast paths: nothing or everything lost */
+  if (received == ~0ULL) {
+    end_burst(w);
+    return;
+  }
+
+  w->lost += 64 - __builtin_popcountll(received);
+
+  if (received == 0) {
+    w->burst_len += 64;
+    return;
+  }
+
+  for (bit = 0; bit < 64; bit++) {
+    if (received & (1ULL << bit))
+      end_burst(w);
+    else
+      w->burst_len++;
+  }
+}
+
+void seq_window_advance(struct seq_window *w, size_t new_base) {
+  size_t nr_words = 0;
+
+  while (w->base < new_base && nr_words < SEQ_WINDOW_SIZE / 64) {
+    evict_word(w);
+    nr_words++;
+  }
+
+  /* the window is empty, so anything beyond it was lost in one burst */
+  if (w->base < new_base) {
+    w->lost      += new_base - w->base;
+    w->burst_len += new_base - w->base;
+    w->base       = new_base;
+  }
+}
+
+void seq_window_end(struct seq_window *w, size_t last_packet_nr) {
+  if (last_packet_nr <= w->max)
+    return;
+
+  /* as if it arrived, but without marking it as received */
+  if (last_packet_nr >= w->base + SEQ_WINDOW_SIZE)
+    seq_window_advance(w, (last_packet_nr - SEQ_WINDOW_SIZE) / 64 * 64 + 64);
+
+  w->max = last_packet_nr;
+}
+
+struct seq_stats seq_window_finish(struct seq_window *w) {
+  struct seq_stats s;
+
+  /* packets beyond the last one are not expected, so mark them as received */
+  w->bits[(w->max / 64) % (SEQ_WINDOW_SIZE / 64)] |= ~((2ULL << (w->max % 64)) - 1);
+
+  seq_window_advance(w, w->max / 64 * 64 + 64);
+  end_burst(w);
+
+  s.expected  = w->max - w->first + 1;
+  s.received  = w->received;
+  s.lost      = w->lost;
+  s.late      = w->late;
+  s.duplicate = w->duplicate;
+  s.stale     = w->stale;
+  s.max_burst = w->max_burst;
+  memcpy(s.burst_hist, w->burst_hist, sizeof s.burst_hist);
+
+  return s;
+}
+
+void seq_stats_add(struct seq_stats *total, const struct seq_stats *s) {
+  int i;
+
+  total->expected  += s->expected;
+  total->received  += s->received;
+  total->lost      += s->lost;
+  total->late      += s->late;
+  total->duplicate += s->duplicate;
+  total->stale     += s->stale;
+
+  if (s->max_burst > total->max_burst)
+    total->max_burst = s->max_burst;
+
+  for (i = 0; i < SEQ_BURST_BUCKETS; i++)
+    total->burst_hist[i] += s->burst_hist[i];
+}
+
+void seq_stats_print_bursts(const char *prefix, const struct seq_stats *s) {
+  int i;
+
+  for (i = 0; i < SEQ_BURST_BUCKETS; i++) {
+    if (s->burst_hist[i] == 0)
+      continue;
+
+    if (i == 0)
+      printf("%sbursts of 1: %lu\n", prefix, s->burst_hist[i]);
+    else if (i == SEQ_BURST_BUCKETS - 1)
+      printf("%sbursts of >=%lu: %lu\n", prefix, 1UL << i, s->burst_hist[i]);
+    else
+      printf("%sbursts of %lu-%lu: %lu\n", prefix, 1UL << i, (2UL << i) - 1, s->burst_hist[i]);
+  }
+}
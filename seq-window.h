@@ -0,0 +1,90 @@
+#ifndef __SEQ_WINDOW__
+#define __SEQ_WINDOW__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of packets tracked behind the highest packet number seen. Packets
+ * arriving later than this are counted as stale (and remain lost).
+ *
+ * Must be a multiple of 64.
+ */
+#define SEQ_WINDOW_SIZE   8192
+
+/* Number of burst-length histogram buckets: 1, 2-3, 4-7, ..., >= 2^(N-1) */
+#define SEQ_BURST_BUCKETS 16
+
+/* Exact packet accounting for one stream of incrementing packet numbers. */
+struct seq_window {
+  uint64_t bits[SEQ_WINDOW_SIZE / 64]; /* ring of received flags, 1 bit per packet */
+
+  size_t first;      /* first packet number seen */
+  size_t base;       /* lowest packet number still tracked, multiple of 64 */
+  size_t max;        /* highest packet number seen */
+
+  size_t received;   /* unique packets received in [first, max] */
+  size_t lost;       /* packets that left the window without being received */
+  size_t late;       /* packets received after a higher packet number (reordered) */
+  size_t duplicate;  /* packets received more than once */
+  size_t stale;      /* packets older than the window, or older than the first packet */
+
+  size_t burst_len;  /* length of the current run of lost packets */
+  size_t max_burst;
+  size_t burst_hist[SEQ_BURST_BUCKETS];
+};
+
+/* Summary of a seq_window, after seq_window_finish(). */
+struct seq_stats {
+  size_t expected;   /* max - first + 1 */
+  size_t received;
+  size_t lost;
+  size_t late;
+  size_t duplicate;
+  size_t stale;
+  size_t max_burst;
+  size_t burst_hist[SEQ_BURST_BUCKETS];
+};
+
+/* Start tracking a stream, of which `first_packet_nr' has just been received. */
+void seq_window_init(struct seq_window *w, size_t first_packet_nr);
+
+/* Move the window up to `new_base', accounting for the packets that leave it. */
+void seq_window_advance(struct seq_window *w, size_t new_base);
+
+/* The stream ended with packet `last_packet_nr': the packets after the highest one
+ * seen were lost. */
+void seq_window_end(struct seq_window *w, size_t last_packet_nr);
+
+/* Account for all packets up to the highest one seen, and return the totals. */
+struct seq_stats seq_window_finish(struct seq_window *w);
+
+/* Add the totals of `s' to `total'. */
+void seq_stats_add(struct seq_stats *total, const struct seq_stats *s);
+
+/* Print the burst-length histogram of `s', one line per non-empty bucket. */
+void seq_stats_print_bursts(const char *prefix, const struct seq_stats *s);
+
+/* Register the reception of packet `packet_nr'. */
+static inline void seq_window_add(struct seq_window *w, size_t packet_nr) {
+  const uint64_t mask = 1ULL << (packet_nr % 64);
+  uint64_t *word = &w->bits[(packet_nr / 64) % (SEQ_WINDOW_SIZE / 64)];
+
+  if (packet_nr > w->max) {
+    if (packet_nr >= w->base + SEQ_WINDOW_SIZE)
+      seq_window_advance(w, (packet_nr - SEQ_WINDOW_SIZE) / 64 * 64 + 64);
+
+    w->max = packet_nr;
+    *word |= mask;
+    w->received++;
+  } else if (packet_nr < w->base || packet_nr < w->first) {
+    w->stale++;
+  } else if (*word & mask) {
+    w->duplicate++;
+  } else {
+    *word |= mask;
+    w->received++;
+    w->late++;
+  }
+}
+
+#endif
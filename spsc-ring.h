@@ -0,0 +1,76 @@
+#ifndef __SPSC_RING__
+#define __SPSC_RING__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/* Bounded lock-free ring of pointers, for a single producer and a single consumer.
+ *
+ * The producer only writes `head', the consumer only writes `tail', each on its
+ * own cache line. Both keep a cached copy of the other index, so they only touch
+ * the other's cache line when the ring looks full or empty.
+ */
+struct spsc_ring {
+  _Alignas(64) atomic_size_t head;  /* next slot to push to */
+  size_t cached_tail;               /* producer's view of tail */
+
+  _Alignas(64) atomic_size_t tail;  /* next slot to pop from */
+  size_t cached_head;               /* consumer's view of head */
+
+  _Alignas(64) size_t mask;         /* number of slots - 1 */
+  void **slots;
+};
+
+/* Initialise a ring of `size' slots, which must be a power of two. */
+static inline void spsc_init(struct spsc_ring *r, size_t size) {
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  r->cached_head = 0;
+  r->cached_tail = 0;
+  r->mask  = size - 1;
+  r->slots = calloc(size, sizeof *r->slots);
+}
+
+static inline void spsc_destroy(struct spsc_ring *r) {
+  free(r->slots);
+}
+
+/* Push an item. Returns 1 on success, 0 if the ring is full. Producer only. */
+static inline int spsc_push(struct spsc_ring *r, void *item) {
+  const size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  if (head - r->cached_tail > r->mask) {
+    r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if (head - r->cached_tail > r->mask)
+      return 0;
+  }
+
+  r->slots[head & r->mask] = item;
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+  return 1;
+}
+
+/* Pop an item. Returns NULL if the ring is empty. Consumer only. */
+static inline void *spsc_pop(struct spsc_ring *r) {
+  const size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+  if (tail == r->cached_head) {
+    r->cached_head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if (tail == r->cached_head)
+      return NULL;
+  }
+
+  void *item = r->slots[tail & r->mask];
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  return item;
+}
+
+/* Number of items in the ring. Exact for the consumer, a snapshot for anyone else. */
+static inline size_t spsc_count(struct spsc_ring *r) {
+  return atomic_load_explicit(&r->head, memory_order_acquire) - atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __WORK_QUEUE__
+#define __WORK_QUEUE__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A unit of work, which may not start before its deadline. */
+struct work_item {
+  uint64_t deadline;  /* in ns, see now_ns() */
+  void *task;
+};
+
+/* Queue of work items of one worker, ordered by deadline, from which other
+ * workers can steal.
+ *
+ * The owner and thieves both take the item with the earliest deadline, as that
+ * is the one that is due first. Queues are short (one item per task at most),
+ * so a spinlock and insertion sort suffice.
+ */
+struct work_queue {
+  pthread_spinlock_t lock;
+  size_t count;
+  size_t capacity;
+  struct work_item *items;  /* earliest deadline first */
+};
+
+static inline void wq_init(struct work_queue *q, size_t capacity) {
+  pthread_spin_init(&q->lock, PTHREAD_PROCESS_PRIVATE);
+  q->count    = 0;
+  q->capacity = capacity;
+  q->items    = calloc(capacity, sizeof *q->items);
+}
+
+static inline void wq_destroy(struct work_queue *q) {
+  pthread_spin_destroy(&q->lock);
+  free(q->items);
+}
+
+/* Add an item. Returns 0 on success, -1 if the queue is full. */
+static inline int wq_push(struct work_queue *q, struct work_item item) {
+  size_t i;
+
+  pthread_spin_lock(&q->lock);
+
+  if (q->count == q->capacity) {
+    pthread_spin_unlock(&q->lock);
+    return -1;
+  }
+
+  /* keep the queue sorted by deadline */
+  for (i = q->count; i > 0 && q->items[i - 1].deadline > item.deadline; i--)
+    q->items[i] = q->items[i - 1];
+
+  q->items[i] = item;
+  __atomic_store_n(&q->count, q->count + 1, __ATOMIC_RELAXED);
+
+  pthread_spin_unlock(&q->lock);
+  return 0;
+}
+
+/* Take the item with the earliest deadline, if that deadline is at or before `now'.
+ * Returns 1 if an item was taken, 0 otherwise. Used by both the owner and thieves. */
+static inline int wq_take_due(struct work_queue *q, uint64_t now, struct work_item *item) {
+  /* peek without the lock first, to keep thieves from bouncing the lock around */
+  if (__atomic_load_n(&q->count, __ATOMIC_RELAXED) == 0)
+    return 0;
+
+  pthread_spin_lock(&q->lock);
+
+  if (q->count == 0 || q->items[0].deadline > now) {
+    pthread_spin_unlock(&q->lock);
+    return 0;
+  }
+
+  *item = q->items[0];
+  __atomic_store_n(&q->count, q->count - 1, __ATOMIC_RELAXED);
+  memmove(&q->items[0], &q->items[1], q->count * sizeof *q->items);
+
+  pthread_spin_unlock(&q->lock);
+  return 1;
+}
+
+/* Return the earliest deadline in the queue, or UINT64_MAX if it is empty. */
+static inline uint64_t wq_next_deadline(struct work_queue *q) {
+  uint64_t deadline;
+
+  pthread_spin_lock(&q->lock);
+  deadline = q->count ? q->items[0].deadline : UINT64_MAX;
+  pthread_spin_unlock(&q->lock);
+
+  return deadline;
+}
+
+#endif